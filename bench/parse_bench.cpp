@@ -0,0 +1,66 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../src/document.h"
+#include "../src/thread_pool.h"
+
+using namespace std;
+
+// builds a document of roughly the requested size out of repeated chapters, each with headers,
+// emphasis, figures, sections and references
+static string generateDocument(size_t target_size)
+{
+    static const string paragraph = "Lorem ipsum dolor sit amet, *consectetur* adipiscing elit, sed do _eiusmod tempor_ incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat.\n\n";
+    string content = "%title{document}\n%config{columns=2;citations=harvard}\n\n";
+    size_t chapter = 0;
+    while (content.size() < target_size)
+    {
+        const string id = "id" + to_string(chapter);
+        content += "# chapter " + to_string(chapter) + "\n%section{id=s" + id + "}\n\n";
+        for (int i = 0; i < 8; ++i)
+        {
+            content += "## part " + to_string(i) + "\n\n";
+            content += paragraph;
+            content += "%fig{image=\"figures/" + id + "_" + to_string(i) + ".png\";id=f" + id + "x" + to_string(i) + "}\n\n";
+            content += paragraph + "see %figref{id=f" + id + "x" + to_string(i) + "} and %sectref{id=s" + id + "}.\n\n";
+        }
+        ++chapter;
+    }
+    return content;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t megabytes = (argc > 1) ? stoul(argv[1]) : 200;
+    const string content = generateDocument(megabytes * 1024 * 1024);
+    cout << "parsing " << content.size() / (1024 * 1024) << " MiB" << endl;
+
+    double single_thread_ms = 0.0;
+    size_t expected_nodes = 0;
+    for (const size_t threads : { 1, 2, 4, 8, 16 })
+    {
+        ThreadPool pool(threads);
+        Document doc;
+        doc.content = content;
+
+        double best_ms = 0.0;
+        for (int run = 0; run < 3; ++run)
+        {
+            const auto start = chrono::steady_clock::now();
+            doc.parse(pool);
+            const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            if (run == 0 || elapsed.count() < best_ms)
+                best_ms = elapsed.count();
+        }
+
+        if (threads == 1)
+        {
+            single_thread_ms = best_ms;
+            expected_nodes = doc.nodes.size();
+        }
+        cout << threads << " threads: " << best_ms << " ms, " << single_thread_ms / best_ms << "x, "
+             << doc.nodes.size() << " nodes, " << doc.diagnostics.size() << " diagnostics"
+             << ((doc.nodes.size() == expected_nodes) ? "" : " (MISMATCH)") << endl;
+    }
+}
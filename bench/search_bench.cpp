@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/regex_search.h"
+#include "../src/text_search.h"
+#include "../src/trigram_index.h"
+
+using namespace std;
+
+// prose with a sprinkling of markup, plus one rare word right at the end so a search for it
+// has to cover the whole buffer
+static string generateText(size_t target_size)
+{
+    static const string paragraph = "Lorem ipsum dolor sit amet, *consectetur* adipiscing elit, sed do _eiusmod tempor_ incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. see %figref{id=fig3}.\n\n";
+    string content;
+    content.reserve(target_size + paragraph.size() + 64);
+    for (size_t i = 0; content.size() < target_size; ++i)
+    {
+        content += paragraph;
+        if (i % 16 == 0)
+            content += "%fig{image=\"figures/" + to_string(i) + ((i % 64 == 0) ? ".svg" : ".png") + "\";id=f" + to_string(i) + "}\n\nEnd of part.  Next part.\n\n";
+    }
+    content += "zygomorphic";
+    return content;
+}
+
+static double bestOf(int runs, const function<size_t()>& body, size_t& result)
+{
+    double best_ms = 0.0;
+    for (int run = 0; run < runs; ++run)
+    {
+        const auto start = chrono::steady_clock::now();
+        result = body();
+        const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best_ms)
+            best_ms = elapsed.count();
+    }
+    return best_ms;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t megabytes = (argc > 1) ? stoul(argv[1]) : 200;
+    const string content = generateText(megabytes * 1024 * 1024);
+    cout << "searching " << content.size() / (1024 * 1024) << " MiB" << endl;
+
+    // the first two only match at the very end, the rest are counted across the whole buffer
+    for (const string needle : { "zygomorphic", "zq", "dolor", "ut labore et dolore", "e", "%figref{" })
+    {
+        const TextSearcher searcher(needle);
+        size_t std_result, searcher_result;
+        const double std_forward = bestOf(3, [&]()
+        {
+            size_t count = 0;
+            for (size_t offset = content.find(needle); offset != string::npos; offset = content.find(needle, offset + 1))
+                ++count;
+            return count;
+        }, std_result);
+        const double searcher_forward = bestOf(3, [&]()
+        {
+            size_t count = 0;
+            for (size_t offset = searcher.findNext(content); offset != TextSearcher::npos; offset = searcher.findNext(content, offset + 1))
+                ++count;
+            return count;
+        }, searcher_result);
+        cout << "\"" << needle << "\" forward: std " << std_forward << " ms, searcher " << searcher_forward << " ms, "
+             << std_forward / searcher_forward << "x, " << searcher_result << " matches"
+             << ((std_result == searcher_result) ? "" : " (MISMATCH)") << endl;
+
+        // walking back from the end, as repeated shift+enter does
+        const double std_backward = bestOf(3, [&]()
+        {
+            size_t count = 0;
+            for (size_t offset = content.rfind(needle); offset != string::npos && offset > 0; offset = content.rfind(needle, offset - 1))
+                ++count;
+            return count;
+        }, std_result);
+        const double searcher_backward = bestOf(3, [&]()
+        {
+            size_t count = 0;
+            for (size_t offset = searcher.findPrevious(content); offset != TextSearcher::npos && offset > 0; offset = searcher.findPrevious(content, offset))
+                ++count;
+            return count;
+        }, searcher_result);
+        cout << "\"" << needle << "\" backward: std " << std_backward << " ms, searcher " << searcher_backward << " ms, "
+             << std_backward / searcher_backward << "x, " << searcher_result << " matches"
+             << ((std_result == searcher_result) ? "" : " (MISMATCH)") << endl;
+    }
+
+    // the trigram index over the same text, and how few blocks it leaves a rare needle to search
+    size_t index_memory = 0;
+    const double index_build = bestOf(3, [&]()
+    {
+        index_memory = TrigramIndex::build(content, SIZE_MAX)->getMemoryUsage();
+        return index_memory;
+    }, index_memory);
+    cout << "trigram index: built in " << index_build << " ms, " << index_memory / 1024 << " KiB" << endl;
+
+    // needles planted across a block boundary, each starting a byte or two either side of it. the
+    // block holding the start has to be a candidate however long the needle is
+    {
+        constexpr size_t boundary = TrigramIndex::block_size * 3;
+        bool missed = false;
+        for (const size_t needle_size : { 3, 4, 64, 65, 66, 67, 100, 200 })
+        {
+            for (size_t start = boundary - 3; start <= boundary + 1; ++start)
+            {
+                string planted = content.substr(0, TrigramIndex::block_size * 6);
+                // no trigram repeats in it, so the last few it has can't be stood in for by earlier ones
+                string needle;
+                uint32_t seed = static_cast<uint32_t>(needle_size);
+                for (size_t i = 0; i < needle_size; ++i)
+                {
+                    seed = seed * 1664525u + 1013904223u;
+                    needle.push_back(static_cast<char>('A' + (seed >> 24) % 26));
+                }
+                planted.replace(start, needle_size, needle);
+                vector<uint32_t> blocks;
+                TrigramIndex::build(planted, SIZE_MAX)->findCandidateBlocks(needle, blocks);
+                if (find(blocks.begin(), blocks.end(), start / TrigramIndex::block_size) == blocks.end())
+                {
+                    cout << "trigram index: " << needle_size << " byte needle at " << start << " not a candidate (MISMATCH)" << endl;
+                    missed = true;
+                }
+            }
+        }
+        if (!missed)
+            cout << "trigram index: needles across block boundaries all found" << endl;
+    }
+
+    // the regex engine on the same text. the literal pattern shows its overhead against the
+    // searcher above, the rest are the sort of thing it's for
+    const double megabytes_searched = static_cast<double>(content.size()) / (1024.0 * 1024.0);
+    for (const string pattern : { "dolor", "%fig\\{[^}]*\\.svg", "\\.  +", "[A-Z][a-z]+ [a-z]+um", "(lab|dol)ore" })
+    {
+        Regex regex(pattern);
+        size_t count = 0;
+        const double elapsed = bestOf(3, [&]()
+        {
+            vector<Regex::Match> matches;
+            regex.findAll(content, 0, content.size(), matches);
+            return matches.size();
+        }, count);
+        cout << "regex \"" << pattern << "\": " << elapsed << " ms, " << megabytes_searched / (elapsed / 1000.0) << " MiB/s, "
+             << count << " matches, " << regex.getCacheFlushes() << " cache flushes" << endl;
+    }
+
+    // a whole paragraph on one line, which is how they're written. the time should grow in step
+    // with the line, not with its square
+    for (const size_t line_size : { 25000, 50000, 100000, 200000, 4000000 })
+    {
+        const string line(line_size, 'a');
+        string prose;
+        while (prose.size() < line_size)
+            prose += "Lorem ipsum dolor sit amet, consectetur adipiscing elit. ";
+        for (const auto& [pattern, text] : { pair<string, const string&>{ "a+", line }, { "a.*z|a", line }, { "\\w+", prose }, { ".+", prose } })
+        {
+            Regex regex(pattern);
+            size_t count = 0;
+            const double elapsed = bestOf(3, [&]()
+            {
+                vector<Regex::Match> matches;
+                regex.findAll(text, 0, text.size(), matches);
+                return matches.size();
+            }, count);
+            cout << "regex \"" << pattern << "\" over one " << line_size << " byte line: " << elapsed << " ms, " << count << " matches" << endl;
+        }
+    }
+}
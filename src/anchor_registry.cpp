@@ -0,0 +1,235 @@
+#include "anchor_registry.h"
+
+using namespace std;
+
+AnchorID AnchorRegistry::create(size_t offset)
+{
+    AnchorID anchor;
+    if (!free_nodes.empty())
+    {
+        anchor = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    else
+    {
+        anchor = static_cast<AnchorID>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    // xorshift is plenty random enough to keep the tree balanced
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    uint32_t left, right;
+    split(root, offset, 0, left, right);
+    const size_t gap = offset - getSum(left);
+    nodes[anchor] = Node{ };
+    nodes[anchor].gap = gap;
+    nodes[anchor].sum = gap;
+    nodes[anchor].priority = seed;
+    nodes[anchor].live = true;
+
+    // the first anchor after the new one is now measured from it instead
+    if (right != NO_ANCHOR)
+        adjustFirstGap(right, 0 - gap);
+    root = merge(merge(left, anchor), right);
+    nodes[root].parent = NO_ANCHOR;
+    return anchor;
+}
+
+void AnchorRegistry::remove(AnchorID anchor)
+{
+    if (!isValid(anchor))
+        return;
+
+    uint32_t left, middle, right, removed;
+    splitCount(root, getRank(anchor), left, middle);
+    splitCount(middle, 1, removed, right);
+    if (right != NO_ANCHOR)
+        adjustFirstGap(right, nodes[removed].gap);
+    root = merge(left, right);
+    if (root != NO_ANCHOR)
+        nodes[root].parent = NO_ANCHOR;
+
+    nodes[anchor].live = false;
+    free_nodes.push_back(anchor);
+}
+
+size_t AnchorRegistry::getOffset(AnchorID anchor) const
+{
+    if (!isValid(anchor))
+        return 0;
+
+    // add up everything to the left on the way up. a collapse which hasn't been pushed down yet
+    // means everything beneath it is really zero
+    const Node& node = nodes[anchor];
+    size_t offset = node.gap + (node.collapse_pending ? 0 : getSum(node.left));
+    for (uint32_t n = anchor, parent = node.parent; parent != NO_ANCHOR; n = parent, parent = nodes[n].parent)
+    {
+        const Node& ancestor = nodes[parent];
+        if (ancestor.collapse_pending)
+            offset = 0;
+        if (ancestor.right == n)
+            offset += ancestor.gap + (ancestor.collapse_pending ? 0 : getSum(ancestor.left));
+    }
+    return offset;
+}
+
+void AnchorRegistry::applyEdit(size_t offset, size_t removed, size_t inserted)
+{
+    if (root == NO_ANCHOR)
+        return;
+
+    // before: at or before the edit, inside: swallowed by the removal, after: shifted along
+    uint32_t before, inside, after, rest;
+    split(root, offset + removed, 0, rest, after);
+    split(rest, offset + 1, 0, before, inside);
+    const size_t before_end = getSum(before);
+    const size_t inside_end = before_end + getSum(inside);
+
+    if (after != NO_ANCHOR)
+    {
+        // new position of the first anchor after, minus the new position of the one before it
+        const size_t previous = (inside != NO_ANCHOR) ? offset : before_end;
+        adjustFirstGap(after, inside_end + inserted - removed - previous);
+    }
+    if (inside != NO_ANCHOR)
+    {
+        collapse(inside);
+        adjustFirstGap(inside, offset - before_end);
+    }
+
+    root = merge(merge(before, inside), after);
+    nodes[root].parent = NO_ANCHOR;
+}
+
+void AnchorRegistry::clear()
+{
+    nodes.clear();
+    free_nodes.clear();
+    root = NO_ANCHOR;
+}
+
+void AnchorRegistry::update(uint32_t n)
+{
+    Node& node = nodes[n];
+    node.count = 1 + getCount(node.left) + getCount(node.right);
+    node.sum = node.gap + getSum(node.left) + getSum(node.right);
+    if (node.left != NO_ANCHOR)
+        nodes[node.left].parent = n;
+    if (node.right != NO_ANCHOR)
+        nodes[node.right].parent = n;
+}
+
+void AnchorRegistry::collapse(uint32_t n)
+{
+    if (n == NO_ANCHOR)
+        return;
+    nodes[n].gap = 0;
+    nodes[n].sum = 0;
+    nodes[n].collapse_pending = true;
+}
+
+void AnchorRegistry::pushDown(uint32_t n)
+{
+    if (!nodes[n].collapse_pending)
+        return;
+    collapse(nodes[n].left);
+    collapse(nodes[n].right);
+    nodes[n].collapse_pending = false;
+}
+
+void AnchorRegistry::split(uint32_t n, size_t key, size_t base, uint32_t& left, uint32_t& right)
+{
+    // anchors before key go left, the rest go right
+    if (n == NO_ANCHOR)
+    {
+        left = right = NO_ANCHOR;
+        return;
+    }
+    pushDown(n);
+    const size_t position = base + getSum(nodes[n].left) + nodes[n].gap;
+    if (position < key)
+    {
+        split(nodes[n].right, key, position, nodes[n].right, right);
+        left = n;
+    }
+    else
+    {
+        split(nodes[n].left, key, base, left, nodes[n].left);
+        right = n;
+    }
+    update(n);
+    if (left != NO_ANCHOR)
+        nodes[left].parent = NO_ANCHOR;
+    if (right != NO_ANCHOR)
+        nodes[right].parent = NO_ANCHOR;
+}
+
+void AnchorRegistry::splitCount(uint32_t n, uint32_t count, uint32_t& left, uint32_t& right)
+{
+    if (n == NO_ANCHOR)
+    {
+        left = right = NO_ANCHOR;
+        return;
+    }
+    pushDown(n);
+    const uint32_t left_count = getCount(nodes[n].left);
+    if (left_count < count)
+    {
+        splitCount(nodes[n].right, count - left_count - 1, nodes[n].right, right);
+        left = n;
+    }
+    else
+    {
+        splitCount(nodes[n].left, count, left, nodes[n].left);
+        right = n;
+    }
+    update(n);
+    if (left != NO_ANCHOR)
+        nodes[left].parent = NO_ANCHOR;
+    if (right != NO_ANCHOR)
+        nodes[right].parent = NO_ANCHOR;
+}
+
+uint32_t AnchorRegistry::merge(uint32_t left, uint32_t right)
+{
+    if (left == NO_ANCHOR)
+        return right;
+    if (right == NO_ANCHOR)
+        return left;
+    if (nodes[left].priority > nodes[right].priority)
+    {
+        pushDown(left);
+        nodes[left].right = merge(nodes[left].right, right);
+        update(left);
+        return left;
+    }
+    pushDown(right);
+    nodes[right].left = merge(left, nodes[right].left);
+    update(right);
+    return right;
+}
+
+void AnchorRegistry::adjustFirstGap(uint32_t n, size_t new_gap_minus_old)
+{
+    // unsigned wraparound makes "adding" a negative difference work out
+    pushDown(n);
+    if (nodes[n].left != NO_ANCHOR)
+        adjustFirstGap(nodes[n].left, new_gap_minus_old);
+    else
+        nodes[n].gap += new_gap_minus_old;
+    update(n);
+}
+
+uint32_t AnchorRegistry::getRank(uint32_t n) const
+{
+    uint32_t rank = getCount(nodes[n].left);
+    for (uint32_t parent = nodes[n].parent; parent != NO_ANCHOR; n = parent, parent = nodes[n].parent)
+    {
+        if (nodes[parent].right == n)
+            rank += getCount(nodes[parent].left) + 1;
+    }
+    return rank;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef uint32_t AnchorID;
+static constexpr AnchorID NO_ANCHOR = static_cast<AnchorID>(-1);
+
+// positions in the buffer which follow the text around as it's edited. anchors are kept in
+// a treap in buffer order, where each node stores the distance from the anchor before it,
+// so an edit only touches the O(log n) nodes around it rather than every anchor after it
+class AnchorRegistry
+{
+private:
+    struct Node
+    {
+        size_t gap = 0;         // distance from the previous anchor (or the start of the buffer)
+        size_t sum = 0;         // total gap of this subtree
+        uint32_t count = 1;
+        uint32_t priority = 0;
+        uint32_t left = NO_ANCHOR;
+        uint32_t right = NO_ANCHOR;
+        uint32_t parent = NO_ANCHOR;
+        bool collapse_pending = false; // children still need their gaps zeroed
+        bool live = false;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<AnchorID> free_nodes;
+    uint32_t root = NO_ANCHOR;
+    uint32_t seed = 0x9E3779B9u;
+
+public:
+    AnchorID create(size_t offset);
+    void remove(AnchorID anchor);
+    size_t getOffset(AnchorID anchor) const;
+    bool isValid(AnchorID anchor) const { return anchor < nodes.size() && nodes[anchor].live; }
+
+    // same convention as EditLog: anchors inside the removed range collapse to its start,
+    // and anchors at or after its end shift along with the text
+    void applyEdit(size_t offset, size_t removed, size_t inserted);
+
+    size_t size() const { return (root == NO_ANCHOR) ? 0 : nodes[root].count; }
+    void clear();
+
+private:
+    void update(uint32_t n);
+    void collapse(uint32_t n);
+    void pushDown(uint32_t n);
+    void split(uint32_t n, size_t key, size_t base, uint32_t& left, uint32_t& right);
+    void splitCount(uint32_t n, uint32_t count, uint32_t& left, uint32_t& right);
+    uint32_t merge(uint32_t left, uint32_t right);
+    void adjustFirstGap(uint32_t n, size_t new_gap_minus_old);
+    uint32_t getRank(uint32_t n) const;
+    size_t getSum(uint32_t n) const { return (n == NO_ANCHOR) ? 0 : nodes[n].sum; }
+    uint32_t getCount(uint32_t n) const { return (n == NO_ANCHOR) ? 0 : nodes[n].count; }
+};
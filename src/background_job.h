@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "thread_pool.h"
+
+// what some work on the thread pool shares with whoever started it. jobs add their own results,
+// guarded by mutex, and set finished once they're all there. the tasks each hold a reference, so
+// the owner can cancel and drop a job at any time, and tasks which haven't started never will
+struct BackgroundJob
+{
+    std::mutex mutex;
+    bool finished = false;
+    std::atomic<bool> cancelled = false;
+
+    bool isCancelled() const { return cancelled.load(); }
+
+    // task is called with the job, unless it's been cancelled by the time the pool gets to it
+    template <typename Job, typename Task>
+    static void submit(ThreadPool& pool, const std::shared_ptr<Job>& job, Task task, TaskPriority priority = PRIORITY_BACKGROUND)
+    {
+        pool.submit([task_job = job, task = std::move(task)]() mutable
+        {
+            if (!task_job->isCancelled())
+                task(*task_job);
+        }, priority);
+    }
+
+    template <typename Job>
+    static void cancel(std::shared_ptr<Job>& job)
+    {
+        if (job)
+            job->cancelled.store(true);
+        job.reset();
+    }
+
+    // stores the results under the lock, and marks the job finished
+    template <typename Store>
+    void finish(Store store)
+    {
+        std::lock_guard lock(mutex);
+        store();
+        finished = true;
+    }
+};
@@ -1,134 +1,424 @@
 #include "document.h"
 
+#include <algorithm>
 #include <cstring>
 
+#include "tag_schema.h"
+#include "thread_pool.h"
+
 using namespace std;
 
+void DocumentNodes::clear()
+{
+    kind.clear();
+    start.clear();
+    length.clear();
+    parent.clear();
+    depth.clear();
+}
+
+uint32_t DocumentNodes::push(NodeKind node_kind, size_t node_start, size_t node_length, uint32_t node_parent)
+{
+    kind.push_back(node_kind);
+    start.push_back(node_start);
+    length.push_back(node_length);
+    parent.push_back(node_parent);
+    depth.push_back((node_parent == NO_PARENT) ? 0 : depth[node_parent] + 1);
+    return static_cast<uint32_t>(kind.size() - 1);
+}
+
+size_t DocumentNodes::findFirstOverlapping(size_t offset) const
+{
+    // last node starting at or before the offset
+    const auto it = upper_bound(start.begin(), start.end(), offset);
+    if (it == start.begin())
+        return 0;
+    size_t index = (it - start.begin()) - 1;
+    
+    // anything earlier which overlaps the offset must be an ancestor of that node
+    size_t first = size();
+    uint32_t current = static_cast<uint32_t>(index);
+    while (current != NO_PARENT)
+    {
+        if (start[current] + length[current] > offset)
+            first = current;
+        current = parent[current];
+    }
+    return (first == size()) ? index + 1 : first;
+}
+
 bool Document::parse()
 {
-    parsing_error_position = -1;
-    parsing_error_desc = "";
+    return parse(ThreadPool::getShared());
+}
+
+bool Document::parse(ThreadPool& pool)
+{
+    diagnostics.clear();
+    nodes.clear();
+    headers.clear();
     
-    vector<Tag> tags;
-    size_t offset = 0;
-    // step through the document
-    while (offset < content.size())
+    // split into chunks at blank lines, which end any open header or emphasis anyway
+    vector<ParseChunk> chunks;
+    const size_t chunk_target = max(min_chunk_size, content.size() / (pool.getThreadCount() * 4));
+    size_t chunk_begin = 0;
+    while (chunk_begin < content.size())
     {
-        if (content[offset] == '%')
+        size_t chunk_end = content.size();
+        if (content.size() - chunk_begin > chunk_target + min_chunk_size)
         {
-            // identify % tags
-            Tag t = extractTag(offset);
-            if (t.start_offset == (size_t)-1)
-                return false;
-            tags.push_back(t);
-            ++offset;
+            const size_t blank_line = content.find("\n\n", chunk_begin + chunk_target);
+            if (blank_line != string::npos)
+                chunk_end = blank_line + 2;
         }
-        // identify other formations (bold, italic, header)
-        else if (content[offset] == '*')
+        chunks.emplace_back();
+        chunks.back().begin = chunk_begin;
+        chunks.back().end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+    
+    pool.parallelFor(chunks.size(), [&](size_t i) { lexChunk(chunks[i]); });
+    
+    // merge in order. a chunk whose last tag ran over its end (a quoted param containing a
+    // blank line) wasn't split safely, so the rest of it is lexed again along with the next chunk
+    tags.clear();
+    size_t overrun = -1;
+    for (auto& chunk : chunks)
+    {
+        if (overrun != (size_t)-1)
         {
+            ParseChunk joined;
+            joined.begin = overrun;
+            joined.end = chunk.end;
+            lexChunk(joined);
+            chunk = std::move(joined);
         }
-        else if (content[offset] == '_')
+        overrun = chunk.overrun;
+        
+        // text split by the chunk boundary is joined back up, so the result matches a serial parse
+        size_t skip = 0;
+        const DocumentNodes& chunk_nodes = chunk.nodes;
+        if (!nodes.kind.empty() && !chunk_nodes.kind.empty()
+            && nodes.kind.back() == NODE_TEXT && nodes.parent.back() == DocumentNodes::NO_PARENT
+            && chunk_nodes.kind[0] == NODE_TEXT && chunk_nodes.parent[0] == DocumentNodes::NO_PARENT)
         {
+            nodes.length.back() += chunk_nodes.length[0];
+            skip = 1;
         }
-        else if (content[offset] == '#')
+        const uint32_t base = static_cast<uint32_t>(nodes.size() - skip);
+        for (uint32_t& parent : chunk.nodes.parent)
         {
-            // tag headers according to their section number (and subsection, and subsubsection etc)
+            if (parent != DocumentNodes::NO_PARENT)
+                parent += base;
         }
-        ++offset;
+        nodes.kind.insert(nodes.kind.end(), chunk_nodes.kind.begin() + skip, chunk_nodes.kind.end());
+        nodes.start.insert(nodes.start.end(), chunk_nodes.start.begin() + skip, chunk_nodes.start.end());
+        nodes.length.insert(nodes.length.end(), chunk_nodes.length.begin() + skip, chunk_nodes.length.end());
+        nodes.parent.insert(nodes.parent.end(), chunk_nodes.parent.begin() + skip, chunk_nodes.parent.end());
+        nodes.depth.insert(nodes.depth.end(), chunk_nodes.depth.begin() + skip, chunk_nodes.depth.end());
+        for (Header& header : chunk.headers)
+        {
+            header.node += base;
+            headers.push_back(std::move(header));
+        }
+        move(chunk.tags.begin(), chunk.tags.end(), back_inserter(tags));
+        move(chunk.diagnostics.begin(), chunk.diagnostics.end(), back_inserter(diagnostics));
     }
     
-    // store all of this in a list of elements (text, bold, italic, header, tags)
-    tag_ids.clear();
-    sections.clear();
-    figures.clear();
-    for (auto& tag : tags)
+    // number headers according to their nesting (section, subsection, subsubsection etc)
+    vector<size_t> header_counters;
+    for (Header& header : headers)
     {
-        if (tag.type == "figref")
+        header_counters.resize(header.level, 0);
+        ++header_counters[header.level - 1];
+        for (const size_t counter : header_counters)
         {
-            string id;
-            if (tag.params.contains("id"))
-                id = tag.params["id"];
-            else
-            {
-                parsing_error_position = tag.start_offset;
-                parsing_error_desc = "'figref' tag missing 'id' param";
-                return false;
-            }
+            if (!header.number.empty())
+                header.number += '.';
+            header.number += to_string(counter);
         }
-        else if (tag.type == "sectref")
+    }
+    
+    resolveTags();
+    buildOutline();
+    
+    // lexing and tag errors are each found in order, but need merging
+    stable_sort(diagnostics.begin(), diagnostics.end(), [](const Diagnostic& a, const Diagnostic& b) { return a.position < b.position; });
+    
+    return !hasErrors();
+}
+
+bool Document::hasErrors() const
+{
+    return any_of(diagnostics.begin(), diagnostics.end(), [](const Diagnostic& d) { return d.severity == SEVERITY_ERROR; });
+}
+
+void Document::lexChunk(ParseChunk& chunk) const
+{
+    DocumentNodes& chunk_nodes = chunk.nodes;
+    vector<uint32_t> open_nodes;
+    size_t text_start = chunk.begin;
+    
+    auto currentParent = [&]()
+    {
+        return open_nodes.empty() ? DocumentNodes::NO_PARENT : open_nodes.back();
+    };
+    auto flushText = [&](size_t end)
+    {
+        if (end > text_start)
+            chunk_nodes.push(NODE_TEXT, text_start, end - text_start, currentParent());
+    };
+    // close the innermost open node of this kind, along with anything opened inside it
+    auto closeNode = [&](NodeKind kind, size_t end)
+    {
+        auto it = find_if(open_nodes.rbegin(), open_nodes.rend(), [&](uint32_t n) { return chunk_nodes.kind[n] == kind; });
+        if (it == open_nodes.rend())
+            return false;
+        const size_t keep = open_nodes.rend() - it - 1;
+        while (open_nodes.size() > keep)
         {
-            string id;
-            if (tag.params.contains("id"))
-                id = tag.params["id"];
-            else
-            {
-                parsing_error_position = tag.start_offset;
-                parsing_error_desc = "'sectref' tag missing 'id' param";
-                return false;
-            }
+            chunk_nodes.length[open_nodes.back()] = end - chunk_nodes.start[open_nodes.back()];
+            open_nodes.pop_back();
         }
-        else if (tag.type == "fig")
+        return true;
+    };
+    auto closeAll = [&](size_t end)
+    {
+        for (const uint32_t n : open_nodes)
+            chunk_nodes.length[n] = end - chunk_nodes.start[n];
+        open_nodes.clear();
+    };
+    
+    size_t offset = chunk.begin;
+    // step through the chunk
+    while (offset < chunk.end)
+    {
+        const char c = content[offset];
+        if (c == '%')
         {
-            string id;
-            if (tag.params.contains("id"))
-                id = tag.params["id"];
-            else
+            // identify % tags. malformed ones are left as plain text
+            const size_t tag_start = offset;
+            flushText(offset);
+            Tag t = extractTag(offset, chunk);
+            if (chunk.overrun != (size_t)-1)
             {
-                parsing_error_position = tag.start_offset;
-                parsing_error_desc = "'fig' tag missing 'id' param";
-                return false;
+                closeAll(tag_start);
+                return;
             }
-            tag_ids.insert(id);
-            
-            string image;
-            if (tag.params.contains("image"))
-                image = tag.params["image"];
+            if (t.start_offset == (size_t)-1)
+                text_start = tag_start;
             else
             {
-                parsing_error_position = tag.start_offset;
-                parsing_error_desc = "'fig' tag missing 'image' param";
-                return false;
+                chunk_nodes.push(NODE_TAG, t.start_offset, t.size + 1, currentParent());
+                chunk.tags.push_back(t);
+                text_start = offset + 1;
             }
-            
-            figures.emplace_back(tag.start_offset, id, image);
         }
-        else if (tag.type == "title")
+        // identify other formations (bold, italic, header)
+        else if (c == '*' || c == '_')
         {
+            flushText(offset);
+            const NodeKind kind = (c == '*') ? NODE_BOLD : NODE_ITALIC;
+            if (!closeNode(kind, offset + 1))
+                open_nodes.push_back(chunk_nodes.push(kind, offset, 0, currentParent()));
+            text_start = offset + 1;
         }
-        else if (tag.type == "config")
+        else if (c == '#' && (offset == 0 || content[offset - 1] == '\n'))
         {
+            // headers are numbered once all the chunks are merged
+            flushText(offset);
+            size_t level = 1;
+            while (offset + level < chunk.end && content[offset + level] == '#')
+                ++level;
+            const uint32_t node = chunk_nodes.push(NODE_HEADER, offset, 0, currentParent());
+            open_nodes.push_back(node);
+            chunk.headers.emplace_back(offset, node, static_cast<uint8_t>(min(level, (size_t)255)), "");
+            offset += level - 1;
+            text_start = offset + 1;
         }
-        else if (tag.type == "bib")
+        else if (c == '\n' && !open_nodes.empty())
         {
+            // headers end with their line, and emphasis can't run on past the end of a paragraph
+            const bool paragraph_end = offset + 1 < content.size() && content[offset + 1] == '\n';
+            const bool in_header = any_of(open_nodes.begin(), open_nodes.end(), [&](uint32_t n) { return chunk_nodes.kind[n] == NODE_HEADER; });
+            if (paragraph_end || in_header)
+            {
+                flushText(offset);
+                if (paragraph_end)
+                    closeAll(offset);
+                else
+                    closeNode(NODE_HEADER, offset);
+                text_start = offset;
+            }
+        }
+        ++offset;
+    }
+    flushText(chunk.end);
+    closeAll(chunk.end);
+}
+
+void Document::resolveTags()
+{
+    ids.clear();
+    defined_ids.assign(tag_schema_count, { });
+    citation_keys.clear();
+    sections.clear();
+    figures.clear();
+    for (auto& tag : tags)
+    {
+        const size_t schema_index = findTagSchema(tag.type);
+        if (schema_index == tag_schema_count)
+        {
+            diagnostics.emplace_back(tag.start_offset, "unrecognised tag type");
+            continue;
         }
-        else if (tag.type == "section")
+        
+        // check required params against the schema table
+        const TagSchema& schema = tag_schemas[schema_index];
+        bool valid = true;
+        for (const string_view required : schema.required)
         {
-            string id;
-            if (tag.params.contains("id"))
-                id = tag.params["id"];
-            else
+            if (required.empty() || tag.params.contains(string(required)))
+                continue;
+            diagnostics.emplace_back(tag.start_offset, "'" + tag.type + "' tag missing '" + string(required) + "' param");
+            valid = false;
+        }
+        if (!valid)
+            continue;
+        
+        // ids are only checked here, since they may be defined in other chunks (or after their references)
+        if (schema.id_role == ID_DEFINES)
+        {
+            IdEntry& entry = ids.insert(tag.params["id"]);
+            if (entry.isDefined())
             {
-                parsing_error_position = tag.start_offset;
-                parsing_error_desc = "'sect' tag missing 'id' param";
-                return false;
+                diagnostics.emplace_back(tag.start_offset, "duplicate id '" + entry.id + "'");
+                entry.duplicates.emplace_back(tag.start_offset, tag.param_offsets["id"], schema_index);
             }
-            tag_ids.insert(id);
-            
-            sections.emplace_back(tag.start_offset, id);
+            else
+                entry.definition = { tag.start_offset, tag.param_offsets["id"], schema_index };
+            defined_ids[schema_index].insert(entry.id);
         }
-        else if (tag.type == "cite")
+        else if (schema.id_role == ID_REFERENCES)
+            ids.insert(tag.params["id"]).references.emplace_back(tag.start_offset, tag.param_offsets["id"], schema_index);
+        
+        switch (schema_index)
         {
-            
+        case tagSchemaIndex("fig"):
+            figures.emplace_back(tag.start_offset, tag.params["id"], tag.params["image"]);
+            break;
+        case tagSchemaIndex("section"):
+            sections.emplace_back(tag.start_offset, tag.params["id"]);
+            break;
+        case tagSchemaIndex("cite"):
+            if (tag.params.contains("key"))
+                citation_keys.insert(tag.params["key"]);
+            break;
+        default: break;
         }
-        else
+    }
+    
+    tag_intervals.build(tags);
+    
+    // now every definition is known, check references against them
+    for (const IdEntry& entry : ids.getEntries())
+    {
+        if (!entry.isDefined())
         {
-            parsing_error_position = tag.start_offset;
-            parsing_error_desc = "unrecognised tag type";
-            return false;
+            for (const IdOccurrence& reference : entry.references)
+                diagnostics.emplace_back(reference.tag_offset, "reference to undefined id '" + entry.id + "'");
+            continue;
+        }
+        const string_view defined_type = tag_schemas[entry.definition.schema].name;
+        for (const IdOccurrence& reference : entry.references)
+        {
+            if (tag_schemas[reference.schema].target != defined_type)
+                diagnostics.emplace_back(reference.tag_offset, "id '" + entry.id + "' belongs to a '" + string(defined_type) + "' tag");
         }
+        if (entry.references.empty() && entry.definition.schema == tagSchemaIndex("fig"))
+            diagnostics.emplace_back(entry.definition.tag_offset, "figure '" + entry.id + "' is never referenced", SEVERITY_WARNING);
     }
+}
+
+void Document::buildOutline()
+{
+    // headers and section tags are each already in order, so merge them
+    outline.clear();
+    size_t tag_index = 0;
+    uint8_t header_level = 0;
+    auto appendSections = [&](size_t before)
+    {
+        for (; tag_index < tags.size() && tags[tag_index].start_offset < before; ++tag_index)
+        {
+            const Tag& tag = tags[tag_index];
+            if (findTagSchema(tag.type) != tagSchemaIndex("section"))
+                continue;
+            // section tags sit one level beneath whichever header they follow
+            const auto title = tag.params.find("title");
+            const auto id = tag.params.find("id");
+            string name = (title != tag.params.end()) ? title->second : (id != tag.params.end()) ? id->second : "";
+            if (name.size() >= 2 && name.front() == '"' && name.back() == '"')
+                name = name.substr(1, name.size() - 2);
+            outline.emplace_back(tag.start_offset, static_cast<uint8_t>(min(header_level + 1, 255)), "%" + name);
+        }
+    };
+    for (const Header& header : headers)
+    {
+        appendSections(header.start_offset);
+        const size_t text_start = header.start_offset + header.level;
+        const size_t line_end = min(content.find('\n', text_start), content.size());
+        const size_t first = content.find_first_not_of(' ', text_start);
+        const string text = (first < line_end) ? content.substr(first, line_end - first) : "";
+        outline.emplace_back(header.start_offset, header.level, header.number + " " + text);
+        header_level = header.level;
+    }
+    appendSections(content.size() + 1);
+
+    // words in text nodes, credited to whichever entry they fall under. a word split by
+    // emphasis markers counts once
+    if (outline.empty())
+        return;
+    size_t entry = 0;
+    bool in_word = false;
+    size_t last_end = 0;
+    for (size_t n = 0; n < nodes.size(); ++n)
+    {
+        if (nodes.kind[n] != NODE_TEXT)
+            continue;
+        if (nodes.start[n] > last_end + 1)
+            in_word = false;
+        last_end = nodes.start[n] + nodes.length[n];
+        for (size_t i = nodes.start[n]; i < last_end; ++i)
+        {
+            while (entry + 1 < outline.size() && outline[entry + 1].start_offset <= i)
+            {
+                ++entry;
+                in_word = false;
+            }
+            const char c = content[i];
+            const bool word_char = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+            if (word_char && !in_word && i >= outline[entry].start_offset)
+                ++outline[entry].words;
+            in_word = word_char;
+        }
+    }
+}
+
+Tag Document::rejectTag(size_t& start_offset, size_t resync_from, size_t error_position, const string& description, ParseChunk& chunk) const
+{
+    chunk.diagnostics.emplace_back(error_position, description);
     
-    return parsing_error_position == (size_t)-1;
+    // skip to the next closing brace or newline and carry on from there. resync_from never
+    // goes back further than the start of the tag, so the parser stays linear
+    const size_t resync = content.find_first_of("}\n", resync_from);
+    if (resync == string::npos)
+        start_offset = content.size();
+    else if (content[resync] == '}')
+        start_offset = resync;
+    else
+        start_offset = resync - 1;
+    
+    return { (size_t)-1 };
 }
 
 string Document::getUniqueID(const string& name) const
@@ -149,12 +439,12 @@ string Document::getUniqueID(const string& name) const
         for (size_t i = 0; i < 8; ++i)
             id.push_back(letters[rand() % strlen(letters)]);
         // check if that name exists (if so, increment seed and repeat)
-    } while (tag_ids.contains(id));
+    } while (ids.contains(id));
     
     return id;
 }
 
-Tag Document::extractTag(size_t& start_offset)
+Tag Document::extractTag(size_t& start_offset, ParseChunk& chunk) const
 {
     // find the end of the tag, and the closing brace (context-aware)
     size_t current = start_offset + 1;
@@ -166,11 +456,14 @@ Tag Document::extractTag(size_t& start_offset)
     bool inside_quotes = false;
     while (true)
     {
-        if (current >= content.size())
+        if (current >= chunk.end)
         {
-            parsing_error_position = start_offset;
-            parsing_error_desc = "incomplete tag";
-            return { (size_t)-1 };
+            if (chunk.end < content.size())
+            {
+                chunk.overrun = start_offset;
+                return { (size_t)-1 };
+            }
+            return rejectTag(start_offset, start_offset + 1, start_offset, "incomplete tag", chunk);
         }
         const char c = content[current];
         if (state == 0)
@@ -181,11 +474,7 @@ Tag Document::extractTag(size_t& start_offset)
                 state = 1;
             }
             else if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
-            {
-                parsing_error_position = current;
-                parsing_error_desc = "invalid character in tag type";
-                return { (size_t)-1 };
-            }
+                return rejectTag(start_offset, current, current, "invalid character in tag type", chunk);
         }
         else if (state == 1)
         {
@@ -208,11 +497,7 @@ Tag Document::extractTag(size_t& start_offset)
                     if (current_equals == static_cast<size_t>(-1))
                         current_equals = current;
                     else
-                    {
-                        parsing_error_position = current;
-                        parsing_error_desc = "only one '=' token permitted per statement";
-                        return { (size_t)-1 };
-                    }
+                        return rejectTag(start_offset, current, current, "only one '=' token permitted per statement", chunk);
                 }
                 else if (c == '}')
                 {
@@ -220,11 +505,7 @@ Tag Document::extractTag(size_t& start_offset)
                     break;
                 }
                 else if (!(c == '_' || c == '-' || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
-                {
-                    parsing_error_position = current;
-                    parsing_error_desc = "invalid character inside tag";
-                    return { (size_t)-1 };
-                }
+                    return rejectTag(start_offset, current, current, "invalid character inside tag", chunk);
             }
         }
         ++current;
@@ -235,11 +516,7 @@ Tag Document::extractTag(size_t& start_offset)
     Tag result;
     result.type = content.substr(start_offset + 1, open_curly - start_offset - 1);
     if (result.type.empty())
-    {
-        parsing_error_position = start_offset;
-        parsing_error_desc = "missing tag type";
-        return { (size_t)-1 };
-    }
+        return rejectTag(start_offset, close_curly, start_offset, "missing tag type", chunk);
     result.start_offset = start_offset;
     result.size = close_curly - start_offset;
 
@@ -258,7 +535,10 @@ Tag Document::extractTag(size_t& start_offset)
         }
         last_end = semicolon_offset;
         if (!key.empty())
+        {
             result.params.emplace(key, value);
+            result.param_offsets.emplace(key, (equals_offset == static_cast<size_t>(-1)) ? semicolon_offset : equals_offset + 1);
+        }
     }
     
     start_offset = close_curly;
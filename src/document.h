@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
-#include <set>
+
+#include "id_index.h"
+#include "interval_index.h"
+#include "prefix_trie.h"
 
 struct Figure
 {
@@ -18,24 +22,113 @@ struct Section
     std::string identifier;
 };
 
+struct Header
+{
+    size_t start_offset;
+    size_t node;
+    uint8_t level;
+    std::string number;
+};
+
+// one line of the outline, from either a '#' header or a %section tag
+struct OutlineEntry
+{
+    size_t start_offset;
+    uint8_t level;
+    std::string title;
+    size_t words = 0; // up to the next entry, of any level
+};
+
 struct Tag
 {
     size_t start_offset;
     size_t size;
     std::string type;
     std::map<std::string, std::string> params;
+    std::map<std::string, size_t> param_offsets;
+};
+
+enum DiagnosticSeverity : uint8_t
+{
+    SEVERITY_ERROR,
+    SEVERITY_WARNING
+};
+
+struct Diagnostic
+{
+    size_t position;
+    std::string description;
+    DiagnosticSeverity severity = SEVERITY_ERROR;
 };
 
+enum NodeKind : uint8_t
+{
+    NODE_TEXT,
+    NODE_BOLD,
+    NODE_ITALIC,
+    NODE_HEADER,
+    NODE_TAG
+};
+
+// inline markup tree, flattened into parallel arrays. nodes are stored in document order,
+// so a node's children always follow it directly
+struct DocumentNodes
+{
+    static constexpr uint32_t NO_PARENT = -1;
+
+    std::vector<NodeKind> kind;
+    std::vector<size_t> start;
+    std::vector<size_t> length;
+    std::vector<uint32_t> parent;
+    std::vector<uint8_t> depth;
+
+    size_t size() const { return kind.size(); }
+    void clear();
+    uint32_t push(NodeKind node_kind, size_t node_start, size_t node_length, uint32_t node_parent);
+    size_t findFirstOverlapping(size_t offset) const;
+};
+
+struct ParseChunk
+{
+    size_t begin;
+    size_t end;
+    DocumentNodes nodes;
+    std::vector<Tag> tags;
+    std::vector<Header> headers;
+    std::vector<Diagnostic> diagnostics;
+    size_t overrun = -1;
+};
+
+class ThreadPool;
+
 struct Document
 {
+    // below this, parsing isn't worth spreading across threads
+    static constexpr size_t min_chunk_size = 1024 * 1024;
+
     std::string content;
-    std::set<std::string> tag_ids; 
+    uint64_t version = 0;
+    std::vector<Tag> tags;
+    IntervalIndex tag_intervals;
+    IdIndex ids;
+    std::vector<PrefixTrie> defined_ids; // for completion, by the schema index of the defining tag
+    PrefixTrie citation_keys;
     std::vector<Figure> figures;
     std::vector<Section> sections;
-    size_t parsing_error_position = -1;
-    std::string parsing_error_desc;
+    std::vector<Header> headers;
+    std::vector<OutlineEntry> outline;
+    DocumentNodes nodes;
+    std::vector<Diagnostic> diagnostics;
 
     bool parse();
+    bool parse(ThreadPool& pool);
+    bool hasErrors() const;
     std::string getUniqueID(const std::string& name) const;
-    Tag extractTag(size_t& start_offset);
+
+private:
+    void lexChunk(ParseChunk& chunk) const;
+    void resolveTags();
+    void buildOutline();
+    Tag extractTag(size_t& start_offset, ParseChunk& chunk) const;
+    Tag rejectTag(size_t& start_offset, size_t resync_from, size_t error_position, const std::string& description, ParseChunk& chunk) const;
 };
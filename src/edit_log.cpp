@@ -0,0 +1,50 @@
+#include "edit_log.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void EditLog::record(uint64_t version, size_t offset, size_t removed, size_t inserted)
+{
+    edits.emplace_back(version, offset, removed, inserted);
+    if (edits.size() > max_edits)
+    {
+        // generations older than the dropped edits can't be mapped any more, and will be
+        // treated as stale until a newer one arrives
+        const size_t drop = edits.size() - (max_edits / 2);
+        oldest_mappable = edits[drop - 1].version;
+        edits.erase(edits.begin(), edits.begin() + static_cast<ptrdiff_t>(drop));
+    }
+}
+
+void EditLog::discardUpTo(uint64_t version)
+{
+    const auto it = find_if(edits.begin(), edits.end(), [version](const TextEdit& e) { return e.version > version; });
+    edits.erase(edits.begin(), it);
+}
+
+size_t EditLog::toBuffer(size_t offset, uint64_t from_version) const
+{
+    for (const TextEdit& edit : edits)
+    {
+        if (edit.version <= from_version)
+            continue;
+        if (offset >= edit.offset + edit.removed)
+            offset = offset + edit.inserted - edit.removed;
+        else if (offset > edit.offset)
+            offset = edit.offset;
+    }
+    return offset;
+}
+
+size_t EditLog::fromBuffer(size_t offset, uint64_t from_version) const
+{
+    for (auto it = edits.rbegin(); it != edits.rend() && it->version > from_version; ++it)
+    {
+        if (offset >= it->offset + it->inserted)
+            offset = offset + it->removed - it->inserted;
+        else if (offset > it->offset)
+            offset = it->offset;
+    }
+    return offset;
+}
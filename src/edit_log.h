@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct TextEdit
+{
+    uint64_t version;
+    size_t offset;
+    size_t removed;
+    size_t inserted;
+};
+
+// edits made to the buffer since older document generations were parsed. lets offsets from
+// a generation be moved forward to the live buffer (and back) without waiting for a reparse
+class EditLog
+{
+private:
+    static constexpr size_t max_edits = 512;
+
+    std::vector<TextEdit> edits;
+    uint64_t oldest_mappable = 0;
+
+public:
+    void record(uint64_t version, size_t offset, size_t removed, size_t inserted);
+    void discardUpTo(uint64_t version);
+    bool canMap(uint64_t from_version) const { return from_version >= oldest_mappable; }
+    size_t toBuffer(size_t offset, uint64_t from_version) const;
+    size_t fromBuffer(size_t offset, uint64_t from_version) const;
+    const std::vector<TextEdit>& getEdits() const { return edits; }
+};
@@ -15,6 +15,12 @@ void EditorDrawable::textEvent(const unsigned int chr)
     {
         if (popup_index == FIND)
             textEventPopupFind(chr);
+        else if (popup_index == RENAME)
+            textEventPopupRename(chr);
+        else if (popup_index == PICKER)
+            textEventPopupPicker(chr);
+        else if (popup_index == FOLDER_SEARCH)
+            textEventPopupFolderSearch(chr);
         return;
     }
     if (input_state == REJECT_NEXT_INPUT)
@@ -26,7 +32,10 @@ void EditorDrawable::textEvent(const unsigned int chr)
         return;
 
     if (chr != '\\')
+    {
         insertReplace(static_cast<char>(chr));
+        updateCompletions();
+    }
     updateLines();
 }
 
@@ -63,6 +72,21 @@ void EditorDrawable::keyEvent(const KeyEvent& evt)
             case PICKER:
                 keyEventPopupPicker(evt);
                 break;
+            case DIAGNOSTICS:
+                keyEventPopupDiagnostics(evt);
+                break;
+            case RENAME:
+                keyEventPopupRename(evt);
+                break;
+            case OUTLINE:
+                keyEventPopupOutline(evt);
+                break;
+            case DOCUMENTS:
+                keyEventPopupDocuments(evt);
+                break;
+            case FOLDER_SEARCH:
+                keyEventPopupFolderSearch(evt);
+                break;
             default: break;
             }
             return;
@@ -76,6 +100,17 @@ void EditorDrawable::keyEvent(const KeyEvent& evt)
             return;
         }
         
+        // completions only survive typing, and tab accepts the top one. the modifier keys
+        // (340 onwards) are let through so shortcuts can still be held
+        if (!completions.empty() && evt.key == 258 && !(evt.modifiers & KeyEvent::CTRL))
+        {
+            acceptCompletion();
+            updateLines();
+            return;
+        }
+        if (evt.key != 259 && (evt.key < 340 || evt.key > 347))
+            completions.clear();
+
         if (evt.modifiers & KeyEvent::CTRL)
             handleCtrlShortcut(evt);
            
@@ -96,6 +131,7 @@ void EditorDrawable::keyEvent(const KeyEvent& evt)
                 --cursor_index;
                 clearSelection();
             }
+            updateCompletions();
             break;
         case 261: // delete
             if ((evt.modifiers & ~KeyEvent::SHIFT) == KeyEvent::CTRL)
@@ -172,6 +208,9 @@ void EditorDrawable::keyEvent(const KeyEvent& evt)
         case 257: // enter/newline
             textEvent('\n');
             break;
+        case 256: // escape
+            find_matches.clear();
+            break;
         default: break;
         }
         updateLines();
@@ -183,22 +222,77 @@ void EditorDrawable::handleCtrlShortcut(const KeyEvent& evt)
     switch (evt.key)
     {
     case 'F':
+        if (evt.modifiers & KeyEvent::SHIFT)
+        {
+            openFolderSearch();
+            break;
+        }
         startPopup(FIND);
+        find_origin = cursor_index;
+        // escape clears the scope along with the matches
+        if (find_scope != SCOPE_ALL && !find_matches.isScoped())
+            updateFindScope();
+        if (find_matches.getNeedle() != find_str || find_matches.getMode() != find_mode)
+            find_matches.search(find_str, text_content, find_mode);
         break;
     case ',':
         startPopup(SETTINGS);
         break;
+    case 'R':
+        startRename();
+        break;
+    case 'G':
+        jumpToDefinitionOrReference();
+        break;
+    case 'T':
+        startOutline();
+        break;
+    case 'W':
+        toggleSplitView();
+        break;
+    case 258: // tab
+        switchPane();
+        break;
+    case 'K':
+        if (evt.modifiers & KeyEvent::SHIFT)
+            unfoldAll();
+        else
+            toggleFold();
+        break;
+    case 'D':
+        popup_option_index = 0;
+        startPopup(DIAGNOSTICS);
+        setStatusText(to_string(doc->diagnostics.size()) + " problems found.");
+        break;
     case 'S':
         triggerSave();
         break;
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        if (evt.modifiers & KeyEvent::SHIFT)
+            toggleBookmark(evt.key - '0');
+        else
+            jumpToBookmark(evt.key - '0');
+        break;
     case 'O':
+        runFileOpenDialog();
+        break;
+    case 'N':
+        newDocument();
+        break;
+    case 'Q':
         if (has_unsaved_changes)
         {
             startPopup(UNSAVED_CONFIRM);
             popup_option_index = 1;
         }
         else
-            runFileOpenDialog();
+            closeDocument();
+        break;
+    case 'B':
+        popup_option_index = static_cast<int>(active_document);
+        startPopup(DOCUMENTS);
+        setStatusText(to_string(documents.size()) + " documents open.");
         break;
     case 'Z':
         popUndoHistory();
@@ -295,9 +389,7 @@ void EditorDrawable::handleHotkeyFollowup(const KeyEvent& evt)
         clearSelection();
         break;
     case 'R':
-        sub_popup_passthrough = 1;
-        popup_option_index = 0;
-        startPopup(PICKER);
+        startPicker(1);
         break;
     case '\\':
         insertReplace('\\');
@@ -344,27 +436,212 @@ void EditorDrawable::runFileOpenDialog()
                               "All Files", "*" },
                             pfd::opt::none);
     const auto result = f.result();
-    if (!result.empty())
+    if (result.empty())
+        return;
+    openFile(result[0]);
+}
+
+// the same file can be reached by paths which don't match, like "./notes.tmd" and "notes.tmd"
+static bool isSameFile(const string& a, const string& b)
+{
+    error_code status;
+    return filesystem::equivalent(a, b, status);
+}
+
+bool EditorDrawable::openFile(const string& file)
+{
+    if (!filesystem::is_regular_file(file))
+    {
+        setStatusText("file is not a regular text file.");
+        return false;
+    }
+    if (isSameFile(file, file_path))
+        return true;
+
+    // already open somewhere, so just go there
+    for (size_t i = 0; i < documents.size(); ++i)
     {
-        const string& file = result[0];
-        if (filesystem::is_regular_file(file))
+        if (i != active_document && isSameFile(file, documents[i].file_path))
         {
-            ifstream file_stream(file, ios::ate);
-            cursor_index = 0;
-            clearSelection();
-            text_content.clear();
-            text_content.resize(file_stream.tellg());
-            fixRN(text_content);
-            file_stream.seekg(ios::beg);
-            file_stream.read(text_content.data(), static_cast<streamsize>(text_content.size()));
-            undo_history.clear();
-            redo_history.clear();
-            pushUndoHistory();
-            file_path = file;
-            has_unsaved_changes = false;
-            needs_save_as = false;
+            switchDocument(i);
+            return true;
         }
-        else
-            setStatusText("file is not a regular text file.");
     }
+    // the untouched starting document gets replaced, anything else opens alongside
+    const size_t previous = active_document;
+    const bool opens_alongside = !needs_save_as || text_version != 1;
+    if (opens_alongside)
+        newDocument();
+    if (!loadFile(file))
+    {
+        // the new document is the last one, so dropping it leaves the others where they were
+        if (opens_alongside)
+        {
+            switchDocument(previous);
+            documents.pop_back();
+            setStatusText("couldn't open " + file + ".");
+        }
+        return false;
+    }
+    updateLines();
+    return true;
+}
+
+bool EditorDrawable::loadFile(const string& file)
+{
+    ifstream file_stream(file, ios::ate | ios::binary);
+    if (!file_stream)
+    {
+        setStatusText("couldn't open " + file + ".");
+        return false;
+    }
+    clearSelection();
+    const size_t old_size = text_content.size();
+    text_content.clear();
+    text_content.resize(file_stream.tellg());
+    file_stream.seekg(ios::beg);
+    file_stream.read(text_content.data(), static_cast<streamsize>(text_content.size()));
+    fixRN(text_content);
+    cursor_index = min(cursor_index, text_content.size());
+    undo_history.clear();
+    redo_history.clear();
+    pushUndoHistory();
+    file_path = file;
+    has_unsaved_changes = false;
+    needs_save_as = false;
+    recordEdit(0, old_size, text_content.size());
+    text_stats.recount(text_content);
+    clearAnchors();
+    return true;
+}
+
+void EditorDrawable::swapDocumentState(OpenDocument& other)
+{
+    swap(text_content, other.text_content);
+    swap(file_path, other.file_path);
+    swap(has_unsaved_changes, other.has_unsaved_changes);
+    swap(needs_save_as, other.needs_save_as);
+    swap(undo_history, other.undo_history);
+    swap(redo_history, other.redo_history);
+    swap(changes_since_push, other.changes_since_push);
+    swap(cursor_index, other.cursor_index);
+    swap(selection_end_index, other.selection_end_index);
+    swap(scroll, other.scroll);
+    swap(parser, other.parser);
+    swap(doc, other.doc);
+    swap(text_version, other.text_version);
+    swap(requested_version, other.requested_version);
+    swap(edit_log, other.edit_log);
+    swap(anchors, other.anchors);
+    swap(bookmarks, other.bookmarks);
+    swap(search_index, other.search_index);
+    swap(search_index_build, other.search_index_build);
+    swap(search_index_version, other.search_index_version);
+    swap(folds, other.folds);
+    swap(split_view, other.split_view);
+    swap(lower_pane_active, other.lower_pane_active);
+    swap(other_pane, other.other_pane);
+    swap(text_stats, other.text_stats);
+}
+
+void EditorDrawable::switchDocument(const size_t index)
+{
+    if (index == active_document || index >= documents.size())
+        return;
+    documents[active_document].last_active = chrono::steady_clock::now();
+    swapDocumentState(documents[active_document]);
+    swapDocumentState(documents[index]);
+    active_document = index;
+
+    // evicted documents come back from disk, landing roughly where they were left
+    const bool was_evicted = documents[index].evicted;
+    documents[index].evicted = false;
+    if (was_evicted)
+        loadFile(file_path);
+    // ids belong to the document, so reference cycling starts over too
+    cycled_id.clear();
+    // matches belong to the buffer, so the search starts over on this one
+    find_matches.resetBuffer();
+    find_matches.setTextIndex(search_index);
+    if (find_scope != SCOPE_ALL)
+        updateFindScope();
+    else if (find_matches.isActive())
+        find_matches.search(find_matches.getNeedle(), text_content, find_matches.getMode());
+    evictBackgroundDocuments();
+    updateLines();
+    setStatusText("switched to " + filesystem::path(file_path).filename().string() + (was_evicted ? " (reloaded)." : "."));
+}
+
+void EditorDrawable::newDocument()
+{
+    documents.emplace_back();
+    switchDocument(documents.size() - 1);
+}
+
+void EditorDrawable::closeDocument()
+{
+    if (documents.size() == 1)
+    {
+        // always keep one document open
+        documents.emplace_back();
+        switchDocument(1);
+        documents.erase(documents.begin());
+        active_document = 0;
+        return;
+    }
+    // swap the closing document's state out, then pull in a neighbour over the top of it
+    const size_t closing = active_document;
+    const size_t next = (closing + 1 < documents.size()) ? closing + 1 : closing - 1;
+    switchDocument(next);
+    documents.erase(documents.begin() + static_cast<ptrdiff_t>(closing));
+    if (active_document > closing)
+        --active_document;
+}
+
+void EditorDrawable::evictBackgroundDocuments()
+{
+    size_t total = 0;
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        if (i != active_document)
+            total += estimateMemory(documents[i]);
+    }
+    // least recently used first, and only documents which can be read back exactly as they were
+    while (total > background_memory_budget)
+    {
+        OpenDocument* oldest = nullptr;
+        for (size_t i = 0; i < documents.size(); ++i)
+        {
+            OpenDocument& candidate = documents[i];
+            if (i == active_document || candidate.evicted || candidate.has_unsaved_changes || candidate.needs_save_as)
+                continue;
+            if (oldest == nullptr || candidate.last_active < oldest->last_active)
+                oldest = &candidate;
+        }
+        if (oldest == nullptr)
+            break;
+        total -= estimateMemory(*oldest);
+        OpenDocument evicted;
+        evicted.file_path = std::move(oldest->file_path);
+        evicted.needs_save_as = false;
+        evicted.cursor_index = oldest->cursor_index;
+        evicted.scroll = oldest->scroll;
+        evicted.last_active = oldest->last_active;
+        evicted.evicted = true;
+        *oldest = std::move(evicted);
+    }
+}
+
+size_t EditorDrawable::estimateMemory(const OpenDocument& document)
+{
+    // the buffer, every undo snapshot, and the parsed generation (roughly its content again in
+    // nodes and tags)
+    size_t total = document.text_content.capacity() + (document.doc->content.size() * 2);
+    for (const string& snapshot : document.undo_history)
+        total += snapshot.capacity();
+    for (const string& snapshot : document.redo_history)
+        total += snapshot.capacity();
+    if (document.search_index)
+        total += document.search_index->getMemoryUsage();
+    return total;
 }
@@ -1,23 +1,58 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 #include <strn.h>
 
+#include "anchor_registry.h"
 #include "document.h"
+#include "edit_log.h"
+#include "folder_search.h"
+#include "fuzzy_matcher.h"
+#include "match_index.h"
+#include "parse_worker.h"
+#include "text_stats.h"
+#include "trigram_index.h"
 
 class EditorDrawable : public STRN::Drawable
 {
 private:
     std::string text_content = "%title{document}\n%config{columns=2;citations=harvard}\n\nLorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum.\n\n%bib{}";
-    std::vector<std::pair<std::string, bool>> lines;
+    // one row of wrapped text, or a placeholder standing in for a folded range
+    struct Line
+    {
+        size_t start;
+        std::string text;
+        bool ends_paragraph;
+        size_t folded = 0; // buffer characters hidden behind the placeholder
+
+        size_t getLength() const { return (folded > 0) ? folded : text.size() + (ends_paragraph ? 1 : 0); }
+        size_t getColumns() const { return (folded > 0) ? 0 : text.size(); }
+    };
+
+    std::vector<Line> lines;
     size_t cursor_index = 0;
     STRN::Vec2 cursor_position = { 0, 0 };
     size_t selection_end_index = 0;
     STRN::Vec2 selection_end_position = { 0, 0 };
     int scroll = 0;
 
+    // the fields above belong to whichever pane has focus. the other pane only keeps its cursor
+    // and selection (as anchors, so they follow edits made from this one) and its scroll. both
+    // panes share the buffer, parse results and wrapped lines
+    struct InactivePane
+    {
+        AnchorID cursor = NO_ANCHOR;
+        AnchorID selection_end = NO_ANCHOR;
+        int scroll = 0;
+    };
+    bool split_view = false;
+    bool lower_pane_active = false;
+    InactivePane other_pane;
+
     enum InputState : uint8_t
     {
         NORMAL_INPUT,
@@ -35,6 +70,11 @@ private:
         SETTINGS,
         FIND,
         PICKER,
+        DIAGNOSTICS,
+        RENAME,
+        OUTLINE,
+        DOCUMENTS,
+        FOLDER_SEARCH,
     };
     
     enum PopupState : uint8_t
@@ -45,6 +85,16 @@ private:
         CLOSING = 3
     };
     
+    // which parts of the document find looks in, going by the last parse
+    enum FindScope : uint8_t
+    {
+        SCOPE_ALL,
+        SCOPE_BODY,    // outside of tags and header lines
+        SCOPE_PARAMS,  // tag parameter values
+        SCOPE_IDS,     // the ids of tags which define or reference them
+        SCOPE_HEADERS
+    };
+    
     std::string info_text = "ready.";
     size_t info_text_limit = 0;
     InputState input_state = NORMAL_INPUT;
@@ -55,6 +105,22 @@ private:
     int popup_option_index = 0;
     int sub_popup_passthrough = 0;
     std::string find_str;
+    MatchIndex find_matches;
+    SearchMode find_mode = SEARCH_EXACT;
+    FindScope find_scope = SCOPE_ALL;
+    std::string replace_str;
+    bool replace_focused = false;    // typing goes to the replacement rather than the query
+    size_t find_origin = 0;          // where the cursor was when the find popup opened
+    bool find_jump_pending = false;  // the query changed, so move to its first match once it's found
+    FolderSearch folder_search;      // shares its query and mode with the find popup
+    std::string cycled_id;          // the id whose references Ctrl + G is working through
+    size_t cycled_reference = 0;    // and which of them it was at last
+    std::string rename_from;
+    std::string rename_str;
+    FuzzyMatcher picker_matcher;
+    std::vector<std::string> completions;
+    size_t completion_start = 0;
+    std::string completion_terminator; // appended on accepting, to move on to the next part of the tag
 
     enum ChangeType : int8_t
     {
@@ -71,8 +137,7 @@ private:
     std::chrono::steady_clock::time_point last_push;
     std::chrono::steady_clock::time_point last_change;
 
-    size_t last_counted_words = 0;
-    std::chrono::steady_clock::time_point last_word_count;
+    TextStats text_stats;
 
     std::string file_path = "untitled.tmd";
     bool has_unsaved_changes = true;
@@ -83,8 +148,66 @@ private:
     int distortion = 2;
     static constexpr float distortion_options[5] = { 0.0f, 0.01f, 0.03f, 0.06f, 0.1f };
     bool enable_animations = true;
+    bool enable_search_index = true;
     
-    Document doc;
+    ParseWorker parser;
+    std::shared_ptr<const Document> doc = parser.getLatest();
+    uint64_t text_version = 1;
+    uint64_t requested_version = 0;
+    EditLog edit_log;
+    AnchorRegistry anchors;
+    std::array<AnchorID, 10> bookmarks = noBookmarks();
+    std::shared_ptr<const TrigramIndex> search_index;       // only while the buffer is unchanged
+    std::shared_ptr<TrigramIndex::Build> search_index_build;
+    uint64_t search_index_version = 0;                      // the last version an index was tried for
+    static constexpr size_t search_index_min_size = 4 * 1024 * 1024;
+    static constexpr size_t search_index_budget = 256 * 1024 * 1024;
+
+    // the end anchor sits on the last folded character, so typing just after a fold stays visible
+    struct Fold
+    {
+        AnchorID start;
+        AnchorID last;
+    };
+    std::vector<Fold> folds;
+
+    // every open document. the focused one's slot is left empty, as its state lives in the members
+    // above and is swapped in and out, so switching documents is just a handful of moves.
+    // background documents keep their last parse but no layout, and saved ones can be evicted
+    // back to disk when they take up too much memory
+    struct OpenDocument
+    {
+        std::string text_content;
+        std::string file_path = "untitled.tmd";
+        bool has_unsaved_changes = false;
+        bool needs_save_as = true;
+        std::vector<std::string> undo_history = { "" };
+        std::vector<std::string> redo_history;
+        int changes_since_push = 0;
+        size_t cursor_index = 0;
+        size_t selection_end_index = 0;
+        int scroll = 0;
+        ParseWorker parser;
+        std::shared_ptr<const Document> doc = parser.getLatest();
+        uint64_t text_version = 1;
+        uint64_t requested_version = 0;
+        EditLog edit_log;
+        AnchorRegistry anchors;
+        std::array<AnchorID, 10> bookmarks = noBookmarks();
+        std::shared_ptr<const TrigramIndex> search_index;
+        std::shared_ptr<TrigramIndex::Build> search_index_build;
+        uint64_t search_index_version = 0;
+        std::vector<Fold> folds;
+        bool split_view = false;
+        bool lower_pane_active = false;
+        InactivePane other_pane;
+        TextStats text_stats;
+        std::chrono::steady_clock::time_point last_active;
+        bool evicted = false;
+    };
+    std::vector<OpenDocument> documents;
+    size_t active_document = 0;
+    static constexpr size_t background_memory_budget = 256ull * 1024 * 1024;
 
     // --- mandatory todos
     // TODO: citation popup and list/bibliography [120]
@@ -95,14 +218,16 @@ private:
     
     // --- optional todos
     // TODO: word wrapping
-    // TODO: syntax highlighting
     
     // --- STRN todos
     // TODO: ability to add custom font
 
 public:
     EditorDrawable()
-    { pushUndoHistory(); }
+    {
+        documents.resize(1);
+        pushUndoHistory();
+    }
 
     void textEvent(unsigned int chr);
     void keyEvent(const STRN::KeyEvent& evt);
@@ -122,6 +247,8 @@ private:
     std::string getSelection() const;
     void clearSelection();
     void surroundSelection(char c);
+    void replaceOccurrences(const std::vector<size_t>& offsets, size_t length, const std::string& replacement);
+    size_t replaceRanges(std::vector<std::pair<size_t, size_t>> ranges, const std::string& replacement);
 
     STRN::Vec2 calculatePosition(size_t index) const;
     void cursorAdvanceLine();
@@ -140,6 +267,8 @@ private:
     static void pushTextPalette(STRN::Context& ctx);
     static void pushSubtextPalette(STRN::Context& ctx);
     static void pushButtonPalette(STRN::Context& ctx);
+    void drawPane(STRN::Context& ctx, STRN::Vec2 text_origin, STRN::Vec2 text_size, size_t cursor, size_t selection_end, int pane_scroll, bool focused) const;
+    void drawHighlighting(STRN::Context& ctx, STRN::Vec2 text_origin, int visible_rows, int pane_scroll) const;
 
     void startPopup(PopupIndex i);
     void stopPopup(bool reject_next_input = true);
@@ -155,8 +284,30 @@ private:
     void drawPopupFind(STRN::Context& ctx) const;
     void textEventPopupFind(unsigned int chr);
     void keyEventPopupFind(const STRN::KeyEvent& evt);
+    void followFindQuery();
+    void replaceAllMatches();
+    // hands the parts of the buffer the scope allows over to the match index
+    void updateFindScope();
+    void openFolderSearch();
+    void startFolderSearch();
+    void drawPopupFolderSearch(STRN::Context& ctx) const;
+    void textEventPopupFolderSearch(unsigned int chr);
+    void keyEventPopupFolderSearch(const STRN::KeyEvent& evt);
     void drawPopupPicker(STRN::Context& ctx) const;
     void keyEventPopupPicker(const STRN::KeyEvent& evt);
+    void textEventPopupPicker(unsigned int chr);
+    void startPicker(int kind);
+    void drawPopupDiagnostics(STRN::Context& ctx) const;
+    void keyEventPopupDiagnostics(const STRN::KeyEvent& evt);
+    void drawPopupRename(STRN::Context& ctx) const;
+    void textEventPopupRename(unsigned int chr);
+    void keyEventPopupRename(const STRN::KeyEvent& evt);
+    void startRename();
+    void startOutline();
+    void drawPopupDocuments(STRN::Context& ctx) const;
+    void keyEventPopupDocuments(const STRN::KeyEvent& evt);
+    void drawPopupOutline(STRN::Context& ctx) const;
+    void keyEventPopupOutline(const STRN::KeyEvent& evt);
 
     int getCharacterType(size_t index) const;
 
@@ -165,11 +316,41 @@ private:
     size_t findEndOfLine(size_t current) const;
     size_t findStartOfLine(size_t current) const;
 
-    size_t countWords();
     static void fixRN(std::string& str);
 
     void setStatusText(const std::string& text);
+    // "1 warning", "3 warnings"
+    static std::string countOf(size_t count, const std::string& noun) { return std::to_string(count) + " " + noun + ((count == 1) ? "" : "s"); }
     void flagUnsaved() { has_unsaved_changes = true; }
+    void recordEdit(size_t offset, size_t removed, size_t inserted);
+    void updateCompletions();
+    void acceptCompletion();
+    void drawCompletions(STRN::Context& ctx, STRN::Vec2 text_origin, int pane_scroll, int visible_rows) const;
+    void recordReplacement(const std::string& previous);
+    void toggleBookmark(size_t slot);
+    void jumpToBookmark(size_t slot);
+    void clearAnchors();
+    static std::array<AnchorID, 10> noBookmarks() { std::array<AnchorID, 10> a; a.fill(NO_ANCHOR); return a; }
+    void swapDocumentState(OpenDocument& other);
+    void switchDocument(size_t index);
+    void newDocument();
+    void closeDocument();
+    bool loadFile(const std::string& file);
+    void evictBackgroundDocuments();
+    static size_t estimateMemory(const OpenDocument& document);
+    void toggleSplitView();
+    void switchPane();
+    int getPaneHeight(bool lower) const;
+    void toggleFold();
+    void unfoldAll();
+    size_t toDocOffset(size_t buffer_offset) const;
+    size_t toBufferOffset(size_t doc_offset) const;
+    const TagInterval* getTagAtCursor() const;
+    void jumpToDefinitionOrReference();
+    std::string getContextHint() const;
+    void pollParseResult();
+    void updateSearchIndex();
     void triggerSave();
     void runFileOpenDialog();
+    bool openFile(const std::string& file);
 };
\ No newline at end of file
@@ -1,33 +1,74 @@
 #include "editor.h"
 
+#include <algorithm>
+
+#include "tag_schema.h"
+#include "thread_pool.h"
+
 using namespace STRN;
 using namespace std;
 
 void EditorDrawable::updateLines()
 {
-    doc.content = text_content;
-    if (!doc.parse())
-        setStatusText("document parsing error: " + doc.parsing_error_desc);
-    // FIXME: this will need to be way faster (skip recalculating lines where possible)
+    if (text_version != requested_version)
+    {
+        parser.request(text_content, text_version);
+        requested_version = text_version;
+    }
+
+    // resolve folds to buffer ranges. a fold the cursor has ended up inside (or which has been
+    // edited away to nothing) is opened back up
+    vector<pair<size_t, size_t>> fold_ranges;
+    for (auto it = folds.begin(); it != folds.end();)
+    {
+        const size_t start = anchors.getOffset(it->start);
+        const size_t end = anchors.getOffset(it->last) + 1;
+        if (end <= start || end > text_content.size() || (cursor_index > start && cursor_index < end))
+        {
+            anchors.remove(it->start);
+            anchors.remove(it->last);
+            it = folds.erase(it);
+            continue;
+        }
+        fold_ranges.emplace_back(start, end);
+        ++it;
+    }
 
-    // wrap text and calculate cursor jump info
+    // wrap text and calculate cursor jump info. folded ranges are skipped over entirely
     lines.clear();
     string line;
+    size_t line_start = 0;
     size_t wrap_width = transform.size.x - 4;
     if (!show_line_checker)
         ++wrap_width;
-    for (const char c : text_content)
+    auto next_fold = fold_ranges.begin();
+    for (size_t i = 0; i < text_content.size(); ++i)
     {
+        if (next_fold != fold_ranges.end() && i == next_fold->first)
+        {
+            if (!line.empty())
+                lines.emplace_back(line_start, line, false);
+            const size_t hidden = next_fold->second - next_fold->first;
+            lines.emplace_back(next_fold->first, "[ + " + to_string(hidden) + " characters folded ]", true, hidden);
+            i = next_fold->second - 1;
+            line_start = next_fold->second;
+            line.clear();
+            ++next_fold;
+            continue;
+        }
+
+        const char c = text_content[i];
         if (c != '\n')
             line.push_back(c);
 
         if (c == '\n' || line.size() >= wrap_width || c == '\0')
         {
-            lines.emplace_back(line, c == '\n');
+            lines.emplace_back(line_start, line, c == '\n');
+            line_start = i + 1;
             line.clear();
         }
     }
-    lines.emplace_back(line, true);
+    lines.emplace_back(line_start, line, true);
 
     // recalculate cursor position based on index
     cursor_position = calculatePosition(cursor_index);
@@ -60,6 +101,8 @@ void EditorDrawable::insertReplace(const string& str)
     else
         checkUndoHistoryState(CHANGE_BLOCK);
     text_content.insert(cursor_index, str);
+    recordEdit(cursor_index, 0, str.size());
+    text_stats.applyEdit(text_content, cursor_index, "", str.size());
     cursor_index += str.size();
     clearSelection();
     flagUnsaved();
@@ -80,13 +123,18 @@ void EditorDrawable::insertReplace(char c)
 void EditorDrawable::insert(const size_t offset, const char c)
 {
     text_content.insert(text_content.begin() + offset, c);
+    recordEdit(offset, 0, 1);
+    text_stats.applyEdit(text_content, offset, "", 1);
     checkUndoHistoryState(CHANGE_REGULAR);
     flagUnsaved();
 }
 
 void EditorDrawable::erase(size_t offset)
 {
+    const char removed = text_content[offset];
     text_content.erase(text_content.begin() + offset);
+    recordEdit(offset, 1, 0);
+    text_stats.applyEdit(text_content, offset, string_view(&removed, 1), 0);
     checkUndoHistoryState(CHANGE_DELETE);
     flagUnsaved();
 }
@@ -98,7 +146,10 @@ void EditorDrawable::eraseSelection()
 
     auto [min_index, length] = getSelectionStartLength();
     cursor_index = min_index;
+    const string removed = text_content.substr(min_index, length);
     text_content.erase(min_index, length);
+    recordEdit(min_index, length, 0);
+    text_stats.applyEdit(text_content, min_index, removed, 0);
     checkUndoHistoryState(CHANGE_BLOCK);
     clearSelection();
     flagUnsaved();
@@ -140,43 +191,97 @@ void EditorDrawable::surroundSelection(char c)
     flagUnsaved();
 }
 
-Vec2 EditorDrawable::calculatePosition(const size_t index) const
+void EditorDrawable::replaceOccurrences(const vector<size_t>& offsets, const size_t length, const string& replacement)
+{
+    vector<pair<size_t, size_t>> ranges;
+    ranges.reserve(offsets.size());
+    for (const size_t offset : offsets)
+        ranges.emplace_back(offset, length);
+    replaceRanges(std::move(ranges), replacement);
+}
+
+size_t EditorDrawable::replaceRanges(vector<pair<size_t, size_t>> ranges, const string& replacement)
 {
-    Vec2 position = { 0, 0 };
-    size_t i = index;
-    size_t line_length = 0;
-    if (position.y < static_cast<int>(lines.size()))
+    if (ranges.empty())
+        return 0;
+    sort(ranges.begin(), ranges.end());
+
+    // the whole batch is a single undo step, and the buffer is rewritten in one pass. the match
+    // index would shift all of its matches for every replacement, so it searches again at the end
+    pushUndoHistory();
+    find_matches.beginEdits();
+
+    size_t last_end = 0;
+    size_t replaced = 0;
+    const bool same_size = all_of(ranges.begin(), ranges.end(), [&replacement](const pair<size_t, size_t>& range) { return range.second == replacement.size(); });
+    if (same_size)
     {
-        line_length = lines[position.y].first.size();
-        if (lines[position.y].second)
-            ++line_length;
+        // nothing else in the buffer needs to move, so each range is written over where it is and
+        // renames cost no more than the references being renamed
+        for (const auto& [offset, length] : ranges)
+        {
+            // overlapping matches can't both be replaced, so the first one wins
+            if (offset < last_end)
+                continue;
+            // a cursor inside a replaced range lands at the start of the replacement
+            if (cursor_index > offset && cursor_index < offset + length)
+                cursor_index = offset;
+            const string removed = text_content.substr(offset, length);
+            text_content.replace(offset, length, replacement);
+            recordEdit(offset, length, length);
+            text_stats.applyEdit(text_content, offset, removed, length);
+            last_end = offset + length;
+            ++replaced;
+        }
     }
-    while (position.y < static_cast<int>(lines.size()) && i >= line_length)
+    else
     {
-        i -= line_length;
-        ++position.y;
-
-        if (position.y < static_cast<int>(lines.size()))
+        string result;
+        result.reserve(text_content.size() + ranges.size() * replacement.size());
+        size_t new_cursor = string::npos;
+        for (const auto& [offset, length] : ranges)
         {
-            line_length = lines[position.y].first.size();
-            if (lines[position.y].second)
-                ++line_length;
+            if (offset < last_end)
+                continue;
+            if (new_cursor == string::npos && cursor_index < offset + length)
+                new_cursor = result.size() + (min(cursor_index, offset) - last_end);
+            result.append(text_content, last_end, offset - last_end);
+            recordEdit(result.size(), length, replacement.size());
+            result.append(replacement);
+            last_end = offset + length;
+            ++replaced;
         }
+        if (new_cursor == string::npos)
+            new_cursor = result.size() + (cursor_index - last_end);
+        result.append(text_content, last_end);
+        text_content = std::move(result);
+        text_stats.recount(text_content);
+        cursor_index = new_cursor;
     }
-    position.x = static_cast<int>(i);
 
-    return position;
+    cursor_index = min(cursor_index, text_content.size());
+    clearSelection();
+    flagUnsaved();
+    find_matches.endEdits(text_content);
+    return replaced;
+}
+
+Vec2 EditorDrawable::calculatePosition(const size_t index) const
+{
+    // the last line starting at or before the index. anything inside a fold sits on its placeholder
+    if (lines.empty())
+        return { 0, 0 };
+    const auto line = upper_bound(lines.begin(), lines.end(), index, [](size_t i, const Line& l) { return i < l.start; }) - 1;
+    const size_t column = (line->folded > 0) ? 0 : index - line->start;
+    return { static_cast<int>(column), static_cast<int>(line - lines.begin()) };
 }
 
 void EditorDrawable::cursorAdvanceLine()
 {
     if (cursor_position.y + 1 < static_cast<int>(lines.size()))
     {
-        cursor_index -= cursor_position.x;
-        cursor_index += lines[cursor_position.y].first.size();
-        if (lines[cursor_position.y].second)
-            ++cursor_index;
-        cursor_index += min(cursor_position.x, static_cast<int>(lines[cursor_position.y + 1].first.size()));
+        const Line& next = lines[cursor_position.y + 1];
+        cursor_index = next.start + min(static_cast<size_t>(cursor_position.x), next.getColumns());
     }
     else
         cursor_index = text_content.size();
@@ -186,11 +291,8 @@ void EditorDrawable::cursorRecedeLine()
 {
     if (cursor_position.y > 0)
     {
-        cursor_index -= cursor_position.x;
-        cursor_index -= lines[cursor_position.y - 1].first.size();
-        if (lines[cursor_position.y - 1].second)
-            --cursor_index;
-        cursor_index += min(cursor_position.x, static_cast<int>(lines[cursor_position.y - 1].first.size()));
+        const Line& previous = lines[cursor_position.y - 1];
+        cursor_index = previous.start + min(static_cast<size_t>(cursor_position.x), previous.getColumns());
     }
     else
         cursor_index = 0;
@@ -198,7 +300,8 @@ void EditorDrawable::cursorRecedeLine()
 
 void EditorDrawable::fixScroll()
 {
-    while (cursor_position.y - scroll >= transform.size.y - 5)
+    const int height = getPaneHeight(lower_pane_active);
+    while (cursor_position.y - scroll >= height)
         ++scroll;
     while (cursor_position.y - scroll < 0 && scroll > 0)
         --scroll;
@@ -248,6 +351,7 @@ void EditorDrawable::popUndoHistory()
     last_push = chrono::steady_clock::now();
     redo_history.push_back(text_content);
     text_content = *(undo_history.end() - 1);
+    recordReplacement(redo_history.back());
     undo_history.pop_back();
     clearSelection();
 }
@@ -260,6 +364,7 @@ void EditorDrawable::popRedoHistory()
     last_push = chrono::steady_clock::now();
     undo_history.push_back(text_content);
     text_content = *(redo_history.end() - 1);
+    recordReplacement(undo_history.back());
     redo_history.pop_back();
     clearSelection();
 }
@@ -339,54 +444,449 @@ size_t EditorDrawable::findStartOfLine(size_t current) const
     return current + 1;
 }
 
-size_t EditorDrawable::countWords()
+void EditorDrawable::fixRN(string& str)
 {
-    const chrono::duration<float> since_last_count = chrono::steady_clock::now() - last_word_count;
-    if (since_last_count.count() < 2.0f)
-        return last_counted_words;
-
-    size_t words = 0;
-    size_t word_length = 0;
-    size_t index = 0;
-    while (index < text_content.size())
+    for (auto it = str.begin(); it != str.end(); ++it)
     {
-        const int char_type = getCharacterType(index);
-        if (char_type != 0)
+        if (*it == '\r')
         {
-            if (word_length > 0)
+            if (it + 1 == str.end() || *(it + 1) != '\n')
+                *it = '\n';
+            else
             {
-                ++words;
-                word_length = 0;
+                ++it;
+                str.erase(it - 1);
+                --it;
             }
         }
+    }
+}
+
+void EditorDrawable::pollParseResult()
+{
+    auto latest = parser.getLatest();
+    if (latest == doc)
+        return;
+    auto countErrors = [](const Document& document)
+    {
+        return static_cast<size_t>(count_if(document.diagnostics.begin(), document.diagnostics.end(), [](const Diagnostic& d) { return d.severity == SEVERITY_ERROR; }));
+    };
+    const size_t old_errors = countErrors(*doc);
+    const size_t old_warnings = doc->diagnostics.size() - old_errors;
+    doc = std::move(latest);
+    edit_log.discardUpTo(doc->version);
+
+    // only news is reported, so typing doesn't keep replacing whatever the status line last said
+    const size_t errors = countErrors(*doc);
+    const size_t warnings = doc->diagnostics.size() - errors;
+    if ((errors != old_errors || warnings != old_warnings) && !doc->diagnostics.empty())
+    {
+        if (errors > 0)
+        {
+            const auto first_error = find_if(doc->diagnostics.begin(), doc->diagnostics.end(), [](const Diagnostic& d) { return d.severity == SEVERITY_ERROR; });
+            string status = "document parsing error: " + first_error->description + " (";
+            if (errors > 1)
+                status += "+" + to_string(errors - 1) + " more, ";
+            if (warnings > 0)
+                status += countOf(warnings, "warning") + ", ";
+            setStatusText(status + "Ctrl + D to list)");
+        }
         else
-            ++word_length;
-        ++index;
+            setStatusText(countOf(warnings, "warning") + " (Ctrl + D to list)");
     }
-    if (word_length > 0)
-        ++words;
+    if (find_scope != SCOPE_ALL)
+        updateFindScope();
+}
 
-    last_counted_words = words;
-    last_word_count = chrono::steady_clock::now();
-    return words;
+void EditorDrawable::recordEdit(const size_t offset, const size_t removed, const size_t inserted)
+{
+    ++text_version;
+    edit_log.record(text_version, offset, removed, inserted);
+    anchors.applyEdit(offset, removed, inserted);
+    find_matches.applyEdit(offset, removed, inserted);
+    search_index.reset();
+    // a build still running is of the text from before, so would only be thrown away
+    BackgroundJob::cancel(search_index_build);
 }
 
-void EditorDrawable::fixRN(string& str)
+void EditorDrawable::updateSearchIndex()
 {
-    for (auto it = str.begin(); it != str.end(); ++it)
+    if (!enable_search_index || text_content.size() < search_index_min_size)
     {
-        if (*it == '\r')
+        search_index.reset();
+        search_index_build.reset();
+        find_matches.setTextIndex(nullptr);
+        return;
+    }
+    if (search_index_build)
+    {
+        shared_ptr<const TrigramIndex> built;
         {
-            if (it + 1 == str.end() || *(it + 1) != '\n')
-                *it = '\n';
-            else
+            lock_guard lock(search_index_build->mutex);
+            if (!search_index_build->finished)
+                return;
+            built = std::move(search_index_build->result);
+        }
+        // an edit while it was building means it's already out of date
+        if (search_index_build->version == text_version)
+        {
+            search_index = std::move(built);
+            find_matches.setTextIndex(search_index);
+            if (!search_index)
+                setStatusText("document too large to index for search.");
+        }
+        search_index_build.reset();
+    }
+
+    // only documents actually being searched get indexed, and only once typing has settled
+    const chrono::duration<float> since_last_edit = chrono::steady_clock::now() - last_change;
+    if (search_index || search_index_build || !find_matches.isActive() || search_index_version == text_version || since_last_edit.count() < 1.0f)
+        return;
+    search_index_version = text_version;
+    search_index_build = TrigramIndex::buildInBackground(ThreadPool::getShared(), text_content, text_version, search_index_budget);
+}
+
+static bool isCompletionCharacter(const char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == ':' || c == '.';
+}
+
+void EditorDrawable::updateCompletions()
+{
+    // tag types never change, so they only need indexing once
+    static const PrefixTrie tag_types = []()
+    {
+        PrefixTrie trie;
+        for (const TagSchema& schema : tag_schemas)
+            trie.insert(schema.name);
+        return trie;
+    }();
+    static constexpr size_t max_completions = 6;
+
+    completions.clear();
+    size_t start = cursor_index;
+    while (start > 0 && isCompletionCharacter(text_content[start - 1]))
+        --start;
+    if (start == 0)
+        return;
+    const string_view prefix = string_view(text_content).substr(start, cursor_index - start);
+    const char trigger = text_content[start - 1];
+    completion_start = start;
+
+    if (trigger == '%')
+    {
+        completions = tag_types.complete(prefix, max_completions);
+        completion_terminator = "{";
+    }
+    else if (trigger == '{' || trigger == ';' || trigger == '=')
+    {
+        // work out which tag this is, from the last '%' on the line. only the line up to the prefix
+        // is looked at, so prose with no tags nearby costs no more than the line itself
+        const size_t newline = text_content.rfind('\n', start - 1);
+        const size_t line_start = (newline == string::npos) ? 0 : newline + 1;
+        const string_view line = string_view(text_content).substr(line_start, start - line_start);
+        const size_t percent = line.rfind('%');
+        if (percent == string_view::npos)
+            return;
+        const size_t brace = line.find('{', percent);
+        if (brace == string_view::npos || line.find('}', brace) != string_view::npos)
+            return;
+        const size_t schema_index = findTagSchema(line.substr(percent + 1, brace - percent - 1));
+        if (schema_index == tag_schema_count)
+            return;
+        const TagSchema& schema = tag_schemas[schema_index];
+
+        if (trigger != '=')
+        {
+            for (const auto& keys : { schema.required, schema.optional })
             {
-                ++it;
-                str.erase(it - 1);
-                --it;
+                for (const string_view key : keys)
+                {
+                    if (!key.empty() && key.starts_with(prefix))
+                        completions.emplace_back(key);
+                }
             }
+            completion_terminator = "=";
+        }
+        else
+        {
+            size_t key_start = start - 1;
+            while (key_start > line_start + brace + 1 && text_content[key_start - 1] != ';')
+                --key_start;
+            const string_view key = string_view(text_content).substr(key_start, start - 1 - key_start);
+            const size_t target = findTagSchema(schema.target);
+            if (key == "id" && schema.id_role == ID_REFERENCES && target < doc->defined_ids.size())
+                completions = doc->defined_ids[target].complete(prefix, max_completions);
+            else if (key == "key" && schema_index == tagSchemaIndex("cite"))
+                completions = doc->citation_keys.complete(prefix, max_completions);
+            completion_terminator = "}";
         }
     }
+
+    // nothing worth offering if it's already been typed out in full
+    if (completions.size() == 1 && completions[0] == prefix)
+        completions.clear();
+}
+
+void EditorDrawable::acceptCompletion()
+{
+    if (completions.empty())
+        return;
+    const string completion = completions[0] + completion_terminator;
+    selection_end_index = completion_start;
+    insertReplace(completion);
+    // closing braces can be typed over later, so leave the cursor before them
+    if (completion_terminator == "}")
+    {
+        --cursor_index;
+        clearSelection();
+    }
+    updateCompletions();
+}
+
+void EditorDrawable::recordReplacement(const string& previous)
+{
+    // undo/redo swap the whole buffer, but only the middle actually changed. recording just that
+    // keeps anchors outside it where they were
+    const size_t limit = min(previous.size(), text_content.size());
+    size_t prefix = 0;
+    while (prefix < limit && previous[prefix] == text_content[prefix])
+        ++prefix;
+    size_t suffix = 0;
+    while (suffix < limit - prefix && previous[previous.size() - suffix - 1] == text_content[text_content.size() - suffix - 1])
+        ++suffix;
+    recordEdit(prefix, previous.size() - prefix - suffix, text_content.size() - prefix - suffix);
+    text_stats.applyEdit(text_content, prefix, string_view(previous).substr(prefix, previous.size() - prefix - suffix), text_content.size() - prefix - suffix);
+}
+
+void EditorDrawable::toggleBookmark(const size_t slot)
+{
+    if (anchors.isValid(bookmarks[slot]))
+    {
+        anchors.remove(bookmarks[slot]);
+        bookmarks[slot] = NO_ANCHOR;
+        setStatusText("cleared bookmark " + to_string(slot) + ".");
+        return;
+    }
+    bookmarks[slot] = anchors.create(cursor_index);
+    setStatusText("set bookmark " + to_string(slot) + ".");
+}
+
+void EditorDrawable::jumpToBookmark(const size_t slot)
+{
+    if (!anchors.isValid(bookmarks[slot]))
+    {
+        setStatusText("bookmark " + to_string(slot) + " is not set (Ctrl + Shift + " + to_string(slot) + " to set it).");
+        return;
+    }
+    cursor_index = min(anchors.getOffset(bookmarks[slot]), text_content.size());
+    clearSelection();
+    setStatusText("jumped to bookmark " + to_string(slot) + ".");
+}
+
+void EditorDrawable::clearAnchors()
+{
+    anchors.clear();
+    bookmarks.fill(NO_ANCHOR);
+    folds.clear();
+    if (split_view)
+        other_pane = { anchors.create(0), anchors.create(0), 0 };
+}
+
+void EditorDrawable::toggleSplitView()
+{
+    if (split_view)
+    {
+        anchors.remove(other_pane.cursor);
+        anchors.remove(other_pane.selection_end);
+        other_pane = { };
+        split_view = false;
+        lower_pane_active = false;
+        setStatusText("closed split view.");
+    }
+    else
+    {
+        // the new pane starts out looking at the same place
+        other_pane = { anchors.create(cursor_index), anchors.create(selection_end_index), scroll };
+        split_view = true;
+        setStatusText("split view (Ctrl + Tab to switch panes).");
+    }
+    updateLines();
+}
+
+void EditorDrawable::switchPane()
+{
+    if (!split_view)
+        return;
+    const InactivePane previous = other_pane;
+    other_pane = { anchors.create(cursor_index), anchors.create(selection_end_index), scroll };
+    cursor_index = min(anchors.getOffset(previous.cursor), text_content.size());
+    selection_end_index = min(anchors.getOffset(previous.selection_end), text_content.size());
+    scroll = previous.scroll;
+    anchors.remove(previous.cursor);
+    anchors.remove(previous.selection_end);
+    lower_pane_active = !lower_pane_active;
+    updateLines();
+}
+
+int EditorDrawable::getPaneHeight(const bool lower) const
+{
+    // one row between the panes is taken up by the divider
+    const int height = transform.size.y - (show_hints ? 5 : 4);
+    if (!split_view)
+        return height;
+    const int upper_height = (height - 1) / 2;
+    return lower ? (height - 1 - upper_height) : upper_height;
+}
+
+void EditorDrawable::toggleFold()
+{
+    // the cursor on a placeholder, or on the line just before one, opens it again
+    const size_t line_end = min(text_content.find('\n', cursor_index), text_content.size());
+    for (auto it = folds.begin(); it != folds.end(); ++it)
+    {
+        const size_t start = anchors.getOffset(it->start);
+        if (start == cursor_index || start == line_end + 1)
+        {
+            anchors.remove(it->start);
+            anchors.remove(it->last);
+            folds.erase(it);
+            updateLines();
+            setStatusText("unfolded section.");
+            return;
+        }
+    }
+
+    if (doc->outline.empty() || !edit_log.canMap(doc->version))
+    {
+        setStatusText("no section to fold.");
+        return;
+    }
+    const size_t cursor = toDocOffset(cursor_index);
+    const auto entry = upper_bound(doc->outline.begin(), doc->outline.end(), cursor,
+                                   [](size_t offset, const OutlineEntry& e) { return offset < e.start_offset; });
+    if (entry == doc->outline.begin())
+    {
+        setStatusText("cursor is not in a section.");
+        return;
+    }
+    // fold everything after the entry's own line, up to the next entry which isn't nested inside it
+    const OutlineEntry& section = *(entry - 1);
+    const auto next = find_if(entry, doc->outline.end(), [&](const OutlineEntry& e) { return e.level <= section.level; });
+    const size_t header_end = text_content.find('\n', toBufferOffset(section.start_offset));
+    const size_t start = (header_end == string::npos) ? text_content.size() : header_end + 1;
+    const size_t end = (next == doc->outline.end()) ? text_content.size() : min(toBufferOffset(next->start_offset), text_content.size());
+    if (end <= start)
+    {
+        setStatusText("section is empty.");
+        return;
+    }
+
+    // folds inside the new one are swallowed by it
+    erase_if(folds, [&](const Fold& f)
+    {
+        const size_t f_start = anchors.getOffset(f.start);
+        if (f_start < start || f_start >= end)
+            return false;
+        anchors.remove(f.start);
+        anchors.remove(f.last);
+        return true;
+    });
+    const Fold fold = { anchors.create(start), anchors.create(end - 1) };
+    const auto position = find_if(folds.begin(), folds.end(), [&](const Fold& f) { return anchors.getOffset(f.start) > start; });
+    folds.insert(position, fold);
+    if (cursor_index > start && cursor_index < end)
+        cursor_index = start;
+    clearSelection();
+    updateLines();
+    setStatusText("folded '" + section.title + "'.");
+}
+
+void EditorDrawable::unfoldAll()
+{
+    for (const Fold& fold : folds)
+    {
+        anchors.remove(fold.start);
+        anchors.remove(fold.last);
+    }
+    folds.clear();
+    updateLines();
+    setStatusText("unfolded everything.");
+}
+
+size_t EditorDrawable::toDocOffset(const size_t buffer_offset) const
+{
+    return edit_log.fromBuffer(buffer_offset, doc->version);
+}
+
+size_t EditorDrawable::toBufferOffset(const size_t doc_offset) const
+{
+    return edit_log.toBuffer(doc_offset, doc->version);
+}
+
+const TagInterval* EditorDrawable::getTagAtCursor() const
+{
+    if (!edit_log.canMap(doc->version))
+        return nullptr;
+    return doc->tag_intervals.findAt(toDocOffset(cursor_index));
+}
+
+void EditorDrawable::jumpToDefinitionOrReference()
+{
+    const TagInterval* interval = getTagAtCursor();
+    if (interval == nullptr || interval->schema >= tag_schema_count || tag_schemas[interval->schema].id_role == ID_NONE)
+    {
+        setStatusText("cursor is not on a tag with an id.");
+        return;
+    }
+    const Tag& tag = doc->tags[interval->tag];
+    const IdEntry* entry = tag.params.contains("id") ? doc->ids.find(tag.params.at("id")) : nullptr;
+    if (entry == nullptr)
+        return;
+
+    size_t target = -1;
+    if (tag_schemas[interval->schema].id_role == ID_REFERENCES)
+    {
+        if (!entry->isDefined())
+        {
+            setStatusText("'" + entry->id + "' is not defined anywhere.");
+            return;
+        }
+        target = entry->definition.tag_offset;
+        // coming back to the definition from a reference carries on from that reference next time
+        const auto visited = find_if(entry->references.begin(), entry->references.end(), [interval](const IdOccurrence& reference) { return reference.tag_offset == interval->start; });
+        if (visited != entry->references.end())
+        {
+            cycled_id = entry->id;
+            cycled_reference = static_cast<size_t>(visited - entry->references.begin());
+        }
+    }
+    else
+    {
+        if (entry->references.empty())
+        {
+            setStatusText("'" + entry->id + "' is never referenced.");
+            return;
+        }
+        // cycle through references, each time going on from the last one visited and wrapping back
+        // to the first. the first time, that's the first one after the definition
+        size_t next = 0;
+        if (cycled_id == entry->id)
+            next = (cycled_reference + 1) % entry->references.size();
+        else
+        {
+            while (next < entry->references.size() && entry->references[next].tag_offset <= interval->start)
+                ++next;
+            if (next == entry->references.size())
+                next = 0;
+        }
+        cycled_id = entry->id;
+        cycled_reference = next;
+        target = entry->references[next].tag_offset;
+    }
+    cursor_index = min(toBufferOffset(target), text_content.size());
+    clearSelection();
+    updateLines();
 }
 
 void EditorDrawable::setStatusText(const string& text)
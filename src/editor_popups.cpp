@@ -1,9 +1,13 @@
 #include "editor.h"
 
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 #include <portable-file-dialogs/portable-file-dialogs.h>
 
+#include "tag_schema.h"
+#include "text_search.h"
+
 using namespace STRN;
 using namespace std;
 
@@ -74,23 +78,37 @@ void EditorDrawable::drawPopupHelp(Context& ctx)
 
     ctx.drawText(Vec2{ 3,  2 }, "Ctrl + S         : save document");
     ctx.drawText(Vec2{ 3,  3 }, "Ctrl + O         : open document");
-    ctx.drawText(Vec2{ 3,  4 }, "Ctrl + C         : copy");
-    ctx.drawText(Vec2{ 3,  5 }, "Ctrl + V         : paste");
-    ctx.drawText(Vec2{ 3,  6 }, "Ctrl + X         : cut");
-    ctx.drawText(Vec2{ 3,  7 }, "Ctrl + Z         : undo");
-    ctx.drawText(Vec2{ 3,  8 }, "Ctrl + Shift + Z : redo");
-    ctx.drawText(Vec2{ 3,  9 }, "Ctrl + F         : find in text");
-    ctx.drawText(Vec2{ 3, 10 }, "Ctrl + E         : show export popup");
-    ctx.drawText(Vec2{ 3, 11 }, "Ctrl + H         : show help popup");
-
-    ctx.drawText(Vec2{ 3, 13 }, "\\, F             : show figure dialog");
-    ctx.drawText(Vec2{ 3, 14 }, "\\, C             : show citation dialog");
-    ctx.drawText(Vec2{ 3, 15 }, "\\, B             : bold selection");
-    ctx.drawText(Vec2{ 3, 16 }, "\\, I             : italic selection");
-    ctx.drawText(Vec2{ 3, 17 }, "\\, M             : insert math block");
-    ctx.drawText(Vec2{ 3, 18 }, "\\, X             : insert code block");
-    ctx.drawText(Vec2{ 3, 19 }, "\\, S             : insert section marker");
-    ctx.drawText(Vec2{ 3, 20 }, "\\, R             : insert section reference");
+    ctx.drawText(Vec2{ 3,  4 }, "Ctrl + N         : new document");
+    ctx.drawText(Vec2{ 3,  5 }, "Ctrl + Q         : close document");
+    ctx.drawText(Vec2{ 3,  6 }, "Ctrl + B         : list open documents");
+    ctx.drawText(Vec2{ 3,  7 }, "Ctrl + C         : copy");
+    ctx.drawText(Vec2{ 3,  8 }, "Ctrl + V         : paste");
+    ctx.drawText(Vec2{ 3,  9 }, "Ctrl + X         : cut");
+    ctx.drawText(Vec2{ 3, 10 }, "Ctrl + Z         : undo");
+    ctx.drawText(Vec2{ 3, 11 }, "Ctrl + Shift + Z : redo");
+    ctx.drawText(Vec2{ 3, 12 }, "Ctrl + F         : find and replace (Esc clears)");
+    ctx.drawText(Vec2{ 3, 13 }, "Ctrl + E         : show export popup");
+    ctx.drawText(Vec2{ 3, 14 }, "Ctrl + H         : show help popup");
+    ctx.drawText(Vec2{ 3, 15 }, "Ctrl + D         : list document problems");
+    ctx.drawText(Vec2{ 3, 16 }, "Ctrl + R         : rename id under cursor");
+    ctx.drawText(Vec2{ 3, 17 }, "Ctrl + G         : go to definition/next reference");
+    ctx.drawText(Vec2{ 3, 18 }, "Ctrl + T         : show document outline");
+    ctx.drawText(Vec2{ 3, 19 }, "Ctrl + K         : fold/unfold current section");
+    ctx.drawText(Vec2{ 3, 20 }, "Ctrl + Shift + K : unfold everything");
+    ctx.drawText(Vec2{ 3, 21 }, "Ctrl + 0-9       : jump to bookmark");
+    ctx.drawText(Vec2{ 3, 22 }, "Ctrl + Shift + # : set/clear bookmark #");
+    ctx.drawText(Vec2{ 3, 23 }, "Ctrl + W         : split/unsplit view");
+    ctx.drawText(Vec2{ 3, 24 }, "Ctrl + Tab       : switch pane");
+    ctx.drawText(Vec2{ 3, 25 }, "Ctrl + Shift + F : find in folder");
+
+    ctx.drawText(Vec2{ 57,  2 }, "\\, F             : show figure dialog");
+    ctx.drawText(Vec2{ 57,  3 }, "\\, C             : show citation dialog");
+    ctx.drawText(Vec2{ 57,  4 }, "\\, B             : bold selection");
+    ctx.drawText(Vec2{ 57,  5 }, "\\, I             : italic selection");
+    ctx.drawText(Vec2{ 57,  6 }, "\\, M             : insert math block");
+    ctx.drawText(Vec2{ 57,  7 }, "\\, X             : insert code block");
+    ctx.drawText(Vec2{ 57,  8 }, "\\, S             : insert section marker");
+    ctx.drawText(Vec2{ 57,  9 }, "\\, R             : insert section reference");
 }
 
 void EditorDrawable::drawPopupFigure(Context& ctx) const
@@ -150,71 +168,31 @@ void EditorDrawable::keyEventPopupFigure(const KeyEvent& evt)
             }
             const auto path = filesystem::path(result[0]);
             const auto doc_path = filesystem::path(file_path);
-            inserted_text = "%fig{image=\"" + filesystem::relative(path, doc_path.parent_path()).string() + "\";id=" + doc.getUniqueID(result[0]);
+            inserted_text = "%fig{image=\"" + filesystem::relative(path, doc_path.parent_path()).string() + "\";id=" + doc->getUniqueID(result[0]);
         }
-        else if (popup_option_index == 1)
+        else if (popup_option_index == 1 || popup_option_index == 2)
         {
-            inserted_text = "%figref{id=";
-            for (auto it = doc.figures.rbegin(); it != doc.figures.rend(); ++it)
+            // next figure starting after the cursor, or the last one finishing before it
+            const size_t cursor = toDocOffset(cursor_index);
+            const TagInterval* figure = nullptr;
+            if (edit_log.canMap(doc->version))
             {
-                if (it->start_offset < cursor_index)
-                {
-                    if (it == doc.figures.rbegin())
-                    {
-                        stopPopup();
-                        setStatusText("nothing to insert.");
-                        return;
-                    }
-                    inserted_text += (it - 1)->identifier;
-                }
-            }
-            if (inserted_text == "%figref{id=")
-            {
-                const auto first = doc.figures.begin();
-                if (first->start_offset > cursor_index)
-                    inserted_text += first->identifier;
+                if (popup_option_index == 1)
+                    figure = doc->tag_intervals.findNext(cursor, tagSchemaIndex("fig"));
                 else
-                {
-                    stopPopup();
-                    setStatusText("nothing to insert.");
-                    return;
-                }
-            }
-        }
-        else if (popup_option_index == 2)
-        {
-            inserted_text = "%figref{id=";
-            for (auto it = doc.figures.begin(); it != doc.figures.end(); ++it)
-            {
-                if (it->start_offset > cursor_index)
-                {
-                    if (it == doc.figures.begin())
-                    {
-                        stopPopup();
-                        setStatusText("nothing to insert.");
-                        return;
-                    }
-                    inserted_text += (it - 1)->identifier;
-                }
+                    figure = doc->tag_intervals.findPrevious(cursor, tagSchemaIndex("fig"));
             }
-            if (inserted_text == "%figref{id=")
+            if (figure == nullptr || !doc->tags[figure->tag].params.contains("id"))
             {
-                const auto last = doc.figures.end() - 1;
-                if (!doc.figures.empty() && last->start_offset < cursor_index)
-                    inserted_text += last->identifier;
-                else
-                {
-                    stopPopup();
-                    setStatusText("nothing to insert.");
-                    return;
-                }
+                stopPopup();
+                setStatusText("nothing to insert.");
+                return;
             }
+            inserted_text = "%figref{id=" + doc->tags[figure->tag].params.at("id");
         }
         else if (popup_option_index == 3)
         {
-            sub_popup_passthrough = 0;
-            popup_option_index = 0;
-            startPopup(PICKER);
+            startPicker(0);
             return;
         }
         else
@@ -227,9 +205,9 @@ void EditorDrawable::keyEventPopupFigure(const KeyEvent& evt)
     }
     else if (evt.key == -1)
     {
-        if (sub_popup_passthrough == -1 || sub_popup_passthrough >= doc.figures.size())
+        if (sub_popup_passthrough == -1 || sub_popup_passthrough >= doc->figures.size())
             return;
-        insertReplace("%figref{id=" + doc.figures[sub_popup_passthrough].identifier + "}");
+        insertReplace("%figref{id=" + doc->figures[sub_popup_passthrough].identifier + "}");
         updateLines();
         stopPopup();
         setStatusText("ready.");
@@ -250,7 +228,7 @@ void EditorDrawable::drawPopupUnsavedConfirm(Context& ctx) const
     ctx.popPalette();
 
     ctx.drawText(Vec2{ 3, 3 }, "you have unsaved changes in the current document.");
-    ctx.drawText(Vec2{ 3, 4 }, "do you want to save them before continuing?");
+    ctx.drawText(Vec2{ 3, 4 }, "do you want to save them before closing it?");
 
     pushButtonPalette(ctx);
     ctx.drawText(Vec2{ 2, ctx.getSize().y - 1 }, "[ DISCARD CHANGES ]", (popup_option_index == 0) ? 1 : 0);
@@ -266,13 +244,9 @@ void EditorDrawable::keyEventPopupUnsavedConfirm(const KeyEvent& evt)
         popup_option_index = 1;
     else if (evt.key == 257)
     {
-        if (popup_option_index == 0)
-            runFileOpenDialog();
-        else
-        {
+        if (popup_option_index == 1)
             triggerSave();
-            runFileOpenDialog();
-        }
+        closeDocument();
         stopPopup();
         setStatusText("ready.");
         updateLines();
@@ -291,12 +265,13 @@ void EditorDrawable::drawPopupSettings(Context& ctx) const
     ctx.drawText(Vec2{ 3, 3 }, (show_line_checker ? enabled : disabled) + " - line checker", (popup_option_index == 0) ? 1 : 0);
     ctx.drawText(Vec2{ 3, 4 }, (show_hints ? enabled : disabled) + " - hotkey hints", (popup_option_index == 1) ? 1 : 0);
     ctx.drawText(Vec2{ 3, 5 }, (enable_animations ? enabled : disabled) + " - UI animations", (popup_option_index == 2) ? 1 : 0);
+    ctx.drawText(Vec2{ 3, 6 }, (enable_search_index ? enabled : disabled) + " - search index for large files", (popup_option_index == 3) ? 1 : 0);
     
 #if defined(GUI)
     string distortion_str(5, '\xC4');
     distortion_str[distortion] = '\xFE';
     distortion_str += format("  [ {:.2f} ]", distortion_options[distortion]);
-    ctx.drawText(Vec2{ 3, 7 }, distortion_str + " - screen distortion", (popup_option_index == 3) ? 1 : 0);
+    ctx.drawText(Vec2{ 3, 8 }, distortion_str + " - screen distortion", (popup_option_index == 4) ? 1 : 0);
 #endif
     ctx.popPalette();
 }
@@ -307,9 +282,9 @@ void EditorDrawable::keyEventPopupSettings(const KeyEvent& evt)
         popup_option_index = max(0, popup_option_index - 1);
     else if (evt.key == 264)
 #if defined(GUI)
-        popup_option_index = min(3, popup_option_index + 1);
+        popup_option_index = min(4, popup_option_index + 1);
 #else
-        popup_option_index = min(2, popup_option_index + 1);
+        popup_option_index = min(3, popup_option_index + 1);
 #endif
     else if (evt.key == 263 || evt.key == 262 || evt.key == 257)
     {
@@ -319,7 +294,8 @@ void EditorDrawable::keyEventPopupSettings(const KeyEvent& evt)
         case 0: setting = &show_line_checker; break;
         case 1: setting = &show_hints; break;
         case 2: setting = &enable_animations; break;
-        case 3: 
+        case 3: setting = &enable_search_index; break;
+        case 4:
             if (evt.key == 262)
                 distortion = min(4, distortion + 1);
             else if (evt.key == 263)
@@ -346,36 +322,114 @@ void EditorDrawable::drawPopupFind(Context& ctx) const
     ctx.popPalette();
     
     ctx.drawText(Vec2{ 3, 2 }, "> " + find_str, 0, 0, ctx.getSize().x - 4);
-    ctx.draw(Vec2{ 5 + static_cast<int>(find_str.size()), 2 }, ' ', 1);
+    ctx.drawText(Vec2{ 3, 4 }, "replace with: " + replace_str, 0, 0, ctx.getSize().x - 4);
+    if (replace_focused)
+        ctx.draw(Vec2{ 17 + static_cast<int>(replace_str.size()), 4 }, ' ', 1);
+    else
+        ctx.draw(Vec2{ 5 + static_cast<int>(find_str.size()), 2 }, ' ', 1);
+
+    static constexpr string_view scope_names[] = { "", "body text only", "tag params only", "ids only", "headers only" };
+    string mode_text;
+    if (find_mode == SEARCH_IGNORE_CASE)
+        mode_text = "ignoring case";
+    else if (find_mode == SEARCH_IGNORE_ACCENTS)
+        mode_text = "ignoring case and accents";
+    else if (find_mode == SEARCH_REGEX)
+        mode_text = find_matches.getError().empty() ? "regex" : "regex: " + find_matches.getError();
+    if (find_scope != SCOPE_ALL)
+        mode_text += (mode_text.empty() ? "" : ", ") + string(scope_names[find_scope]);
+    if (!mode_text.empty())
+    {
+        pushSubtextPalette(ctx);
+        ctx.drawText(Vec2{ 3, 3 }, "(" + mode_text + ")");
+        ctx.popPalette();
+    }
+    if (find_matches.isActive())
+    {
+        const size_t count = find_matches.getMatches().size();
+        const string status = find_matches.isReady() ? (to_string(count) + ((count == 1) ? " match" : " matches")) : "searching...";
+        pushSubtextPalette(ctx);
+        ctx.drawText(Vec2{ ctx.getSize().x - 3 - static_cast<int>(status.size()), 2 }, status);
+        ctx.popPalette();
+    }
     
     pushButtonPalette(ctx);
-    ctx.drawText(Vec2{ 2, ctx.getSize().y - 1 }, "[ ENTER/SHIFT+ENTER TO ADVANCE ]");
+    if (replace_focused)
+        ctx.drawText(Vec2{ 2, ctx.getSize().y - 1 }, "[ ENTER TO REPLACE ALL, UP TO FIND ]");
+    else
+        ctx.drawText(Vec2{ 2, ctx.getSize().y - 1 }, "[ ENTER/SHIFT+ENTER TO ADVANCE, TAB FOR MODE, SHIFT+TAB FOR SCOPE, DOWN TO REPLACE ]");
     ctx.popPalette();
 }
 
 void EditorDrawable::textEventPopupFind(unsigned int chr)
 {
+    if (replace_focused)
+    {
+        replace_str.push_back(chr);
+        return;
+    }
     find_str.push_back(chr);
+    find_matches.setQuery(find_str, text_content, find_mode);
+    find_jump_pending = true;
 }
 
 void EditorDrawable::keyEventPopupFind(const KeyEvent& evt)
 {
+    if (evt.key == 264 || evt.key == 265)
+    {
+        replace_focused = (evt.key == 264);
+        return;
+    }
+    if (replace_focused)
+    {
+        if (evt.key == 257)
+            replaceAllMatches();
+        else if (evt.key == 259 && !replace_str.empty())
+            replace_str.pop_back();
+        return;
+    }
+
     if (evt.key == 257)
     {
         if (find_str.empty())
             return;
         
-        size_t offset;
-        if (evt.modifiers == KeyEvent::SHIFT)
+        // the index answers straight away once it's built, otherwise search directly
+        size_t offset = string::npos;
+        const bool index_current = find_matches.isReady() && find_matches.getNeedle() == find_str && find_matches.getMode() == find_mode;
+        if (!index_current && (find_scope != SCOPE_ALL || (find_mode != SEARCH_EXACT && find_mode != SEARCH_REGEX)))
         {
-            if (cursor_index > 0)
-                offset = text_content.rfind(find_str, cursor_index - 1);
+            // folding and scopes are only done through the index, so that has to be waited for
+            setStatusText("still searching.");
+            return;
+        }
+        if (index_current)
+        {
+            const vector<size_t>& matches = find_matches.getMatches();
+            const size_t next = find_matches.findFirst((evt.modifiers == KeyEvent::SHIFT) ? cursor_index : cursor_index + 1);
+            if (evt.modifiers == KeyEvent::SHIFT && next > 0)
+                offset = matches[next - 1];
+            else if (evt.modifiers != KeyEvent::SHIFT && next < matches.size())
+                offset = matches[next];
+        }
+        else if (find_mode == SEARCH_REGEX)
+        {
+            Regex regex(find_str);
+            if (evt.modifiers == KeyEvent::SHIFT)
+                offset = regex.findPrevious(text_content, cursor_index).start;
             else
-                offset = string::npos;
+                offset = regex.findNext(text_content, cursor_index + 1).start;
         }
         else
-            offset = text_content.find(find_str, cursor_index + 1);
+        {
+            const TextSearcher searcher(find_str);
+            if (evt.modifiers == KeyEvent::SHIFT)
+                offset = searcher.findPrevious(text_content, cursor_index);
+            else
+                offset = searcher.findNext(text_content, cursor_index + 1);
+        }
         
+        find_jump_pending = false;
         if (offset == string::npos)
             setStatusText("nothing more to find.");
         else
@@ -388,8 +442,176 @@ void EditorDrawable::keyEventPopupFind(const KeyEvent& evt)
     else if (evt.key == 259)
     {
         if (!find_str.empty())
+        {
             find_str.pop_back();
+            find_matches.setQuery(find_str, text_content, find_mode);
+            find_jump_pending = true;
+        }
+    }
+    else if (evt.key == 258 && evt.modifiers == KeyEvent::SHIFT)
+    {
+        find_scope = static_cast<FindScope>((find_scope + 1) % (SCOPE_HEADERS + 1));
+        updateFindScope();
+        find_jump_pending = true;
+    }
+    else if (evt.key == 258)
+    {
+        find_mode = static_cast<SearchMode>((find_mode + 1) % (SEARCH_REGEX + 1));
+        find_matches.search(find_str, text_content, find_mode);
+        find_jump_pending = true;
+    }
+}
+
+void EditorDrawable::updateFindScope()
+{
+    if (find_scope == SCOPE_ALL)
+    {
+        find_matches.clearScope(text_content);
+        return;
+    }
+    // the ranges come from the last parse, so have to be carried over any edits made since
+    if (!edit_log.canMap(doc->version))
+        return;
+
+    vector<pair<size_t, size_t>> ranges;
+    auto addHeaderLines = [&](vector<pair<size_t, size_t>>& result)
+    {
+        for (const Header& header : doc->headers)
+            result.emplace_back(header.start_offset, min(doc->content.find('\n', header.start_offset), doc->content.size()));
+    };
+    switch (find_scope)
+    {
+    case SCOPE_BODY:
+    {
+        // everything that isn't a tag or a header
+        vector<pair<size_t, size_t>> excluded;
+        for (const Tag& tag : doc->tags)
+            excluded.emplace_back(tag.start_offset, tag.start_offset + tag.size + 1);
+        addHeaderLines(excluded);
+        sort(excluded.begin(), excluded.end());
+        size_t body_start = 0;
+        for (const auto& [start, end] : excluded)
+        {
+            if (start > body_start)
+                ranges.emplace_back(body_start, start);
+            body_start = max(body_start, end);
+        }
+        if (body_start < doc->content.size())
+            ranges.emplace_back(body_start, doc->content.size());
+        break;
+    }
+    case SCOPE_PARAMS:
+    case SCOPE_IDS:
+        for (const Tag& tag : doc->tags)
+        {
+            const size_t schema = findTagSchema(tag.type);
+            const bool has_id = schema != tag_schema_count && tag_schemas[schema].id_role != ID_NONE;
+            for (const auto& [key, value_offset] : tag.param_offsets)
+            {
+                if (find_scope == SCOPE_PARAMS || (has_id && key == "id"))
+                    ranges.emplace_back(value_offset, value_offset + tag.params.at(key).size());
+            }
+        }
+        break;
+    case SCOPE_HEADERS:
+        addHeaderLines(ranges);
+        break;
+    default: break;
+    }
+
+    sort(ranges.begin(), ranges.end());
+    vector<pair<size_t, size_t>> buffer_ranges;
+    for (const auto& [start, end] : ranges)
+    {
+        const size_t buffer_start = toBufferOffset(start);
+        const size_t buffer_end = min(toBufferOffset(end), text_content.size());
+        if (buffer_start < buffer_end && (buffer_ranges.empty() || buffer_start >= buffer_ranges.back().second))
+            buffer_ranges.emplace_back(buffer_start, buffer_end);
     }
+    find_matches.setScope(std::move(buffer_ranges), text_content);
+}
+
+void EditorDrawable::replaceAllMatches()
+{
+    if (find_str.empty())
+        return;
+
+    // the index already has everything when it's caught up, otherwise search the buffer here
+    vector<pair<size_t, size_t>> ranges;
+    const bool index_current = find_matches.isReady() && find_matches.getNeedle() == find_str && find_matches.getMode() == find_mode;
+    if (!index_current && (find_scope != SCOPE_ALL || (find_mode != SEARCH_EXACT && find_mode != SEARCH_REGEX)))
+    {
+        setStatusText("still searching.");
+        return;
+    }
+    if (index_current)
+    {
+        const vector<size_t>& matches = find_matches.getMatches();
+        ranges.reserve(matches.size());
+        for (size_t m = 0; m < matches.size(); ++m)
+            ranges.emplace_back(matches[m], find_matches.getLength(m));
+    }
+    else if (find_mode == SEARCH_REGEX)
+    {
+        Regex regex(find_str);
+        vector<Regex::Match> found;
+        regex.findAll(text_content, 0, text_content.size(), found);
+        for (const Regex::Match& match : found)
+            ranges.emplace_back(match.start, match.length);
+    }
+    else
+    {
+        const TextSearcher searcher(find_str);
+        for (size_t offset = searcher.findNext(text_content); offset != TextSearcher::npos; offset = searcher.findNext(text_content, offset + find_str.size()))
+            ranges.emplace_back(offset, find_str.size());
+    }
+
+    const size_t replaced = replaceRanges(std::move(ranges), replace_str);
+    if (replaced == 0)
+    {
+        setStatusText("nothing to replace.");
+        return;
+    }
+    updateLines();
+    setStatusText("replaced " + to_string(replaced) + ((replaced == 1) ? " occurrence." : " occurrences."));
+}
+
+void EditorDrawable::followFindQuery()
+{
+    if (!find_jump_pending || !find_matches.isReady())
+        return;
+    // as the query is typed, the cursor sits on the first match from where the search started,
+    // wrapping around to the top, and goes back there when nothing matches
+    find_jump_pending = false;
+    const vector<size_t>& matches = find_matches.getMatches();
+    const size_t next = find_matches.findFirst(find_origin);
+    if (matches.empty())
+        cursor_index = find_origin;
+    else
+        cursor_index = (next < matches.size()) ? matches[next] : matches.front();
+    cursor_index = min(cursor_index, text_content.size());
+    clearSelection();
+    updateLines();
+}
+
+void EditorDrawable::startPicker(const int kind)
+{
+    // figures are listed by path and sections by id, as that's what they'll be recognised by
+    vector<string> candidates;
+    if (kind == 0)
+    {
+        for (const Figure& figure : doc->figures)
+            candidates.push_back(figure.target_path);
+    }
+    else if (kind == 1)
+    {
+        for (const Section& section : doc->sections)
+            candidates.push_back(section.identifier);
+    }
+    picker_matcher.setCandidates(std::move(candidates));
+    sub_popup_passthrough = kind;
+    popup_option_index = 0;
+    startPopup(PICKER);
 }
 
 void EditorDrawable::drawPopupPicker(Context& ctx) const
@@ -403,62 +625,426 @@ void EditorDrawable::drawPopupPicker(Context& ctx) const
     }
     ctx.drawText(Vec2{ 2, 0 }, title);
     ctx.popPalette();
-    
-    if (sub_popup_passthrough == 0)
+
+    ctx.drawText(Vec2{ 3, 2 }, "> " + picker_matcher.getQuery(), 0, 0, ctx.getSize().x - 4);
+    ctx.drawColour(Vec2{ 5 + static_cast<int>(picker_matcher.getQuery().size()), 2 }, 1);
+
+    // keep the selection in view
+    const auto& results = picker_matcher.getResults();
+    const int visible = max(ctx.getSize().y - 8, 1);
+    const int first = clamp(popup_option_index - (visible / 2), 0, max(static_cast<int>(results.size()) - visible, 0));
+    pushButtonPalette(ctx);
+    int y = 4;
+    for (size_t i = first; i < results.size() && y < 4 + visible; ++i, ++y)
+        ctx.drawText(Vec2{ 3, y }, "[ " + picker_matcher.getCandidate(results[i].index) + " ]", i == static_cast<size_t>(popup_option_index), 0, ctx.getSize().x - 6);
+    ctx.popPalette();
+    pushSubtextPalette(ctx);
+    ctx.drawText(Vec2{ 3, y }, results.empty() ? "no matches" : "end of list");
+    ctx.popPalette();
+}
+
+void EditorDrawable::textEventPopupPicker(const unsigned int chr)
+{
+    if (chr < 32 || chr > 126)
+        return;
+    picker_matcher.setQuery(picker_matcher.getQuery() + static_cast<char>(chr));
+    popup_option_index = 0;
+}
+
+void EditorDrawable::keyEventPopupPicker(const KeyEvent& evt)
+{
+    const auto& results = picker_matcher.getResults();
+    if (evt.key == 265)
+        popup_option_index = max(0, popup_option_index - 1);
+    else if (evt.key == 264)
+        popup_option_index = min(results.empty() ? 0 : static_cast<int>(results.size()) - 1, popup_option_index + 1);
+    else if (evt.key == 259 && !picker_matcher.getQuery().empty())
+    {
+        const string& query = picker_matcher.getQuery();
+        picker_matcher.setQuery(query.substr(0, query.size() - 1));
+        popup_option_index = 0;
+    }
+    else if (evt.key == 257)
     {
-        pushButtonPalette(ctx);
-        int y = 3;
-        for (size_t i = popup_option_index; i < doc.figures.size(); ++i)
+        if (results.empty())
+            return;
+        // the figure popup underneath picks up the chosen index once this one closes
+        const uint32_t chosen = results[popup_option_index].index;
+        if (sub_popup_passthrough == 1 && chosen < doc->sections.size())
         {
-            if (y >= ctx.getSize().y - 4)
-                break;
-            ctx.drawText(Vec2{ 3, y }, "[ " + doc.figures[i].target_path + " ]", i == popup_option_index);
-            ++y;
+            insertReplace("%sectref{id=" + doc->sections[chosen].identifier + "}");
+            updateLines();
         }
-        ctx.popPalette();
+        sub_popup_passthrough = static_cast<int>(chosen);
+        stopPopup();
+    }
+}
+
+void EditorDrawable::drawPopupDiagnostics(Context& ctx) const
+{
+    pushTitlePalette(ctx);
+    ctx.drawText(Vec2{ 2, 0 }, "[ PROBLEMS ]");
+    ctx.popPalette();
+
+    if (doc->diagnostics.empty())
+    {
         pushSubtextPalette(ctx);
-        ctx.drawText(Vec2{ 3, y }, "end of list");
+        ctx.drawText(Vec2{ 3, 3 }, "no problems found.");
         ctx.popPalette();
+        return;
+    }
+
+    pushButtonPalette(ctx);
+    int y = 3;
+    for (size_t i = popup_option_index; i < doc->diagnostics.size(); ++i)
+    {
+        if (y >= ctx.getSize().y - 4)
+            break;
+        const Diagnostic& diagnostic = doc->diagnostics[i];
+        string excerpt = (diagnostic.position < text_content.size()) ? text_content.substr(diagnostic.position, 24) : "";
+        replace(excerpt.begin(), excerpt.end(), '\n', ' ');
+        const string severity = (diagnostic.severity == SEVERITY_ERROR) ? "error: " : "warning: ";
+        ctx.drawText(Vec2{ 3, y }, "[ " + severity + diagnostic.description + " ] " + excerpt, i == static_cast<size_t>(popup_option_index), 0, ctx.getSize().x - 6);
+        ++y;
     }
-    else if (sub_popup_passthrough == 1)
+    ctx.popPalette();
+    pushSubtextPalette(ctx);
+    ctx.drawText(Vec2{ 3, y }, "end of list");
+    ctx.popPalette();
+}
+
+void EditorDrawable::keyEventPopupDiagnostics(const KeyEvent& evt)
+{
+    if (evt.key == 265)
+        popup_option_index = max(0, popup_option_index - 1);
+    else if (evt.key == 264)
+        popup_option_index = min(doc->diagnostics.empty() ? 0 : static_cast<int>(doc->diagnostics.size()) - 1, popup_option_index + 1);
+    else if (evt.key == 257)
     {
-        pushButtonPalette(ctx);
-        int y = 3;
-        for (size_t i = popup_option_index; i < doc.sections.size(); ++i)
+        if (doc->diagnostics.empty())
+            return;
+        const Diagnostic diagnostic = doc->diagnostics[popup_option_index];
+        cursor_index = min(diagnostic.position, text_content.size());
+        clearSelection();
+        updateLines();
+        stopPopup();
+        setStatusText(diagnostic.description);
+    }
+}
+
+void EditorDrawable::startRename()
+{
+    if (doc->version != text_version)
+    {
+        setStatusText("document is still being parsed.");
+        return;
+    }
+    const TagInterval* interval = getTagAtCursor();
+    if (interval == nullptr || interval->schema >= tag_schema_count || tag_schemas[interval->schema].id_role == ID_NONE
+        || !doc->tags[interval->tag].params.contains("id"))
+    {
+        setStatusText("cursor is not on a tag with an id.");
+        return;
+    }
+    // ids may be written quoted or not, and either way are renamed as the bare id
+    rename_from = doc->tags[interval->tag].params.at("id");
+    if (rename_from.size() >= 2 && rename_from.front() == '"' && rename_from.back() == '"')
+        rename_from = rename_from.substr(1, rename_from.size() - 2);
+    rename_str = rename_from;
+    startPopup(RENAME);
+    setStatusText("renaming '" + rename_from + "'.");
+}
+
+void EditorDrawable::drawPopupRename(Context& ctx) const
+{
+    pushTitlePalette(ctx);
+    ctx.drawText(Vec2{ 2, 0 }, "[ RENAME ID ]");
+    ctx.popPalette();
+
+    ctx.drawText(Vec2{ 3, 2 }, "> " + rename_str, 0, 0, ctx.getSize().x - 4);
+    ctx.draw(Vec2{ 5 + static_cast<int>(rename_str.size()), 2 }, ' ', 1);
+
+    pushButtonPalette(ctx);
+    ctx.drawText(Vec2{ 2, ctx.getSize().y - 1 }, "[ ENTER TO RENAME ]");
+    ctx.popPalette();
+}
+
+void EditorDrawable::textEventPopupRename(unsigned int chr)
+{
+    // ids have to survive being parsed back out of a tag
+    if (chr == '_' || chr == '-' || (chr >= '0' && chr <= '9') || (chr >= 'A' && chr <= 'Z') || (chr >= 'a' && chr <= 'z'))
+        rename_str.push_back(static_cast<char>(chr));
+}
+
+void EditorDrawable::keyEventPopupRename(const KeyEvent& evt)
+{
+    if (evt.key == 259)
+    {
+        if (!rename_str.empty())
+            rename_str.pop_back();
+    }
+    else if (evt.key == 257)
+    {
+        if (rename_str.empty() || rename_str == rename_from)
+            return;
+        if (doc->ids.contains(rename_str) || doc->ids.contains('"' + rename_str + '"'))
         {
-            if (y >= ctx.getSize().y - 4)
-                break;
-            ctx.drawText(Vec2{ 3, y }, "[ " + doc.sections[i].identifier + " ]", i == popup_option_index);
-            ++y;
+            setStatusText("id '" + rename_str + "' is already in use.");
+            return;
         }
-        ctx.popPalette();
+        const IdEntry* bare = doc->ids.find(rename_from);
+        const IdEntry* quoted = doc->ids.find('"' + rename_from + '"');
+        if ((bare == nullptr && quoted == nullptr) || doc->version != text_version)
+        {
+            setStatusText("document changed, nothing renamed.");
+            stopPopup();
+            return;
+        }
+
+        // only the text between any quotes is replaced, so each occurrence keeps its own quoting
+        vector<size_t> offsets;
+        auto addOccurrence = [&](const IdOccurrence& occurrence)
+        {
+            offsets.push_back(occurrence.value_offset + ((text_content[occurrence.value_offset] == '"') ? 1 : 0));
+        };
+        for (const IdEntry* entry : { bare, quoted })
+        {
+            if (entry == nullptr)
+                continue;
+            if (entry->isDefined())
+                addOccurrence(entry->definition);
+            for (const IdOccurrence& duplicate : entry->duplicates)
+                addOccurrence(duplicate);
+            for (const IdOccurrence& reference : entry->references)
+                addOccurrence(reference);
+        }
+        replaceOccurrences(offsets, rename_from.size(), rename_str);
+        updateLines();
+        stopPopup();
+        setStatusText("renamed " + countOf(offsets.size(), "occurrence") + " of '" + rename_from + "'.");
+    }
+}
+
+void EditorDrawable::startOutline()
+{
+    if (doc->outline.empty())
+    {
+        setStatusText("document has no headers or sections.");
+        return;
+    }
+    // start on the entry the cursor is currently under
+    popup_option_index = 0;
+    if (edit_log.canMap(doc->version))
+    {
+        const size_t cursor = toDocOffset(cursor_index);
+        const auto it = upper_bound(doc->outline.begin(), doc->outline.end(), cursor,
+                                    [](size_t offset, const OutlineEntry& e) { return offset < e.start_offset; });
+        if (it != doc->outline.begin())
+            popup_option_index = static_cast<int>(it - doc->outline.begin()) - 1;
+    }
+    startPopup(OUTLINE);
+    setStatusText(to_string(doc->outline.size()) + " outline entries.");
+}
+
+void EditorDrawable::drawPopupOutline(Context& ctx) const
+{
+    pushTitlePalette(ctx);
+    ctx.drawText(Vec2{ 2, 0 }, "[ OUTLINE ]");
+    ctx.popPalette();
+
+    if (doc->outline.empty())
+    {
         pushSubtextPalette(ctx);
-        ctx.drawText(Vec2{ 3, y }, "end of list");
+        ctx.drawText(Vec2{ 3, 3 }, "no headers or sections.");
         ctx.popPalette();
+        return;
+    }
+
+    // keep the selected entry roughly in the middle of the list
+    const int visible = max(ctx.getSize().y - 6, 1);
+    const int first = clamp(popup_option_index - (visible / 2), 0, max(static_cast<int>(doc->outline.size()) - visible, 0));
+    pushButtonPalette(ctx);
+    int y = 3;
+    for (size_t i = first; i < doc->outline.size() && y < 3 + visible; ++i, ++y)
+    {
+        const OutlineEntry& entry = doc->outline[i];
+        const int indent = min((entry.level - 1) * 2, 20);
+        const string words = to_string(entry.words) + " words";
+        ctx.drawText(Vec2{ 3 + indent, y }, "[ " + entry.title + " ]", i == static_cast<size_t>(popup_option_index), 0, ctx.getSize().x - 18 - indent);
+        ctx.drawText(Vec2{ ctx.getSize().x - 3 - static_cast<int>(words.size()), y }, words);
     }
+    ctx.popPalette();
 }
 
-void EditorDrawable::keyEventPopupPicker(const KeyEvent& evt)
+void EditorDrawable::keyEventPopupOutline(const KeyEvent& evt)
 {
-    size_t array_size = 0;
-    switch (sub_popup_passthrough)
+    if (evt.key == 265)
+        popup_option_index = max(0, popup_option_index - 1);
+    else if (evt.key == 264)
+        popup_option_index = min(doc->outline.empty() ? 0 : static_cast<int>(doc->outline.size()) - 1, popup_option_index + 1);
+    else if (evt.key == 257)
     {
-    case 0: array_size = doc.figures.size(); break;
-    case 1: array_size = doc.sections.size(); break;
+        if (doc->outline.empty() || !edit_log.canMap(doc->version))
+            return;
+        cursor_index = min(toBufferOffset(doc->outline[popup_option_index].start_offset), text_content.size());
+        clearSelection();
+        updateLines();
+        // put the entry at the top of the view rather than just scrolling it into view
+        scroll = min(cursor_position.y, max(static_cast<int>(lines.size()) - (transform.size.y - 5), 0));
+        stopPopup();
+        setStatusText(doc->outline[popup_option_index].title);
     }
-    
+}
+
+void EditorDrawable::drawPopupDocuments(Context& ctx) const
+{
+    pushTitlePalette(ctx);
+    ctx.drawText(Vec2{ 2, 0 }, "[ OPEN DOCUMENTS ]");
+    ctx.popPalette();
+
+    pushButtonPalette(ctx);
+    int y = 3;
+    for (size_t i = 0; i < documents.size() && y < ctx.getSize().y - 3; ++i, ++y)
+    {
+        // the focused document's details live in the editor rather than its slot
+        const bool focused = (i == active_document);
+        const OpenDocument& document = documents[i];
+        const string& path = focused ? file_path : document.file_path;
+        const bool unsaved = focused ? has_unsaved_changes : document.has_unsaved_changes;
+        string label = "[ " + string(unsaved ? "(*) " : "") + filesystem::path(path).filename().string() + " ]";
+        if (focused)
+            label += " - editing";
+        else if (document.evicted)
+            label += " - on disk";
+        ctx.drawText(Vec2{ 3, y }, label, i == static_cast<size_t>(popup_option_index), 0, ctx.getSize().x - 6);
+    }
+    ctx.popPalette();
+    pushSubtextPalette(ctx);
+    ctx.drawText(Vec2{ 3, y + 1 }, "(Ctrl + N) new document  (Ctrl + Q) close document");
+    ctx.popPalette();
+}
+
+void EditorDrawable::keyEventPopupDocuments(const KeyEvent& evt)
+{
     if (evt.key == 265)
         popup_option_index = max(0, popup_option_index - 1);
     else if (evt.key == 264)
-        popup_option_index = min((array_size == 0) ? 0 : static_cast<int>(array_size) - 1, popup_option_index + 1);
+        popup_option_index = min(static_cast<int>(documents.size()) - 1, popup_option_index + 1);
     else if (evt.key == 257)
     {
-        if (sub_popup_passthrough == 1)
+        stopPopup();
+        if (static_cast<size_t>(popup_option_index) == active_document)
+            setStatusText("ready.");
+        else
+            switchDocument(popup_option_index);
+    }
+}
+
+void EditorDrawable::openFolderSearch()
+{
+    // untitled documents have nowhere on disk yet, so they search wherever the editor was started
+    const filesystem::path folder = needs_save_as ? filesystem::current_path() : filesystem::path(file_path).parent_path();
+    folder_search.setFolder(folder.empty() ? filesystem::path(".") : folder);
+    startPopup(FOLDER_SEARCH);
+    startFolderSearch();
+    setStatusText("searching " + countOf(folder_search.getFiles().size(), "file") + " in the document's folder.");
+}
+
+void EditorDrawable::startFolderSearch()
+{
+    folder_search.start(find_str, find_mode);
+    popup_option_index = 0;
+}
+
+void EditorDrawable::drawPopupFolderSearch(Context& ctx) const
+{
+    pushTitlePalette(ctx);
+    ctx.drawText(Vec2{ 2, 0 }, "[ FIND IN FOLDER ]");
+    ctx.popPalette();
+
+    ctx.drawText(Vec2{ 3, 2 }, "> " + find_str, 0, 0, ctx.getSize().x - 4);
+    ctx.draw(Vec2{ 5 + static_cast<int>(find_str.size()), 2 }, ' ', 1);
+
+    const vector<FolderSearch::Hit>& hits = folder_search.getHits();
+    const size_t files_total = folder_search.getFiles().size();
+    string status = to_string(hits.size()) + ((hits.size() == 1) ? " hit" : " hits");
+    if (folder_search.isRunning())
+        status += ", searched " + to_string(folder_search.getFilesDone()) + "/" + to_string(files_total) + " files...";
+    else
+        status += " in " + to_string(files_total) + ((files_total == 1) ? " file" : " files") + (folder_search.isTruncated() ? " (stopped)" : "");
+    string mode_text;
+    if (!folder_search.getError().empty())
+        mode_text = "(" + folder_search.getError() + ")";
+    else if (find_mode == SEARCH_IGNORE_CASE)
+        mode_text = "(ignoring case)";
+    else if (find_mode == SEARCH_IGNORE_ACCENTS)
+        mode_text = "(ignoring case and accents)";
+    else if (find_mode == SEARCH_REGEX)
+        mode_text = "(regex)";
+    pushSubtextPalette(ctx);
+    ctx.drawText(Vec2{ ctx.getSize().x - 3 - static_cast<int>(status.size()), 2 }, status);
+    ctx.drawText(Vec2{ 3, 3 }, mode_text);
+    ctx.popPalette();
+
+    // keep the selected hit roughly in the middle of the list
+    const int visible = max(ctx.getSize().y - 7, 1);
+    const int first = clamp(popup_option_index - (visible / 2), 0, max(static_cast<int>(hits.size()) - visible, 0));
+    pushButtonPalette(ctx);
+    int y = 5;
+    for (size_t i = first; i < hits.size() && y < 5 + visible; ++i, ++y)
+    {
+        const FolderSearch::Hit& hit = hits[i];
+        const string location = folder_search.getFiles()[hit.file].filename().string() + ":" + to_string(hit.line + 1);
+        ctx.drawText(Vec2{ 3, y }, "[ " + location + " ]", i == static_cast<size_t>(popup_option_index), 0, 34);
+        ctx.drawText(Vec2{ 38, y }, hit.preview, 0, 0, ctx.getSize().x - 41);
+    }
+    ctx.popPalette();
+
+    pushButtonPalette(ctx);
+    ctx.drawText(Vec2{ 2, ctx.getSize().y - 1 }, "[ ENTER TO OPEN, TAB FOR MODE ]");
+    ctx.popPalette();
+}
+
+void EditorDrawable::textEventPopupFolderSearch(unsigned int chr)
+{
+    find_str.push_back(chr);
+    startFolderSearch();
+}
+
+void EditorDrawable::keyEventPopupFolderSearch(const KeyEvent& evt)
+{
+    const vector<FolderSearch::Hit>& hits = folder_search.getHits();
+    if (evt.key == 265)
+        popup_option_index = max(0, popup_option_index - 1);
+    else if (evt.key == 264)
+        popup_option_index = min(hits.empty() ? 0 : static_cast<int>(hits.size()) - 1, popup_option_index + 1);
+    else if (evt.key == 259 && !find_str.empty())
+    {
+        find_str.pop_back();
+        startFolderSearch();
+    }
+    else if (evt.key == 258)
+    {
+        find_mode = static_cast<SearchMode>((find_mode + 1) % (SEARCH_REGEX + 1));
+        startFolderSearch();
+    }
+    else if (evt.key == 257 && static_cast<size_t>(popup_option_index) < hits.size())
+    {
+        // hits are stored by line and column, which survive the line ending fixes made on load
+        const FolderSearch::Hit hit = hits[popup_option_index];
+        stopPopup();
+        if (!openFile(folder_search.getFiles()[hit.file].string()))
+            return;
+        size_t line_start = 0;
+        for (size_t line = 0; line < hit.line && line_start < text_content.size(); ++line)
         {
-            insertReplace("%sectref{id=" + doc.sections[popup_option_index].identifier + "}");
-            updateLines();
+            const size_t newline = text_content.find('\n', line_start);
+            line_start = (newline == string::npos) ? text_content.size() : newline + 1;
         }
-        sub_popup_passthrough = popup_option_index;
-        stopPopup();
+        const size_t line_end = min(text_content.find('\n', line_start), text_content.size());
+        cursor_index = min(line_start + hit.column, line_end);
+        clearSelection();
+        updateLines();
+        setStatusText(folder_search.getFiles()[hit.file].filename().string() + ", line " + to_string(hit.line + 1) + ".");
     }
 }
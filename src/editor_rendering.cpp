@@ -1,10 +1,13 @@
 #include "editor.h"
 
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 #include <portable-file-dialogs/portable-file-dialogs.h>
 #include <math.h>
 
+#include "tag_schema.h"
+
 using namespace STRN;
 using namespace std;
 
@@ -23,6 +26,11 @@ static string getMemorySize(size_t bytes)
 void EditorDrawable::render(Context& ctx)
 {
     checkUndoHistoryState(CHANGE_CHECK);
+    pollParseResult();
+    updateSearchIndex();
+    find_matches.update(text_content);
+    folder_search.update();
+    followFindQuery();
 
     int text_box_left = 1;
     if (!show_line_checker)
@@ -50,7 +58,10 @@ void EditorDrawable::render(Context& ctx)
     // header
     static const string unsaved_editing = "[ IAPETUS ] (*) editing ";
     static const string saved_editing = "[ IAPETUS ] - editing ";
-    ctx.drawText({ 1, 0 }, (has_unsaved_changes ? unsaved_editing : saved_editing) + filesystem::path(file_path).filename().string());
+    string document_count;
+    if (documents.size() > 1)
+        document_count = " (" + to_string(active_document + 1) + "/" + to_string(documents.size()) + ")";
+    ctx.drawText({ 1, 0 }, (has_unsaved_changes ? unsaved_editing : saved_editing) + filesystem::path(file_path).filename().string() + document_count);
     const string file_size = getMemorySize(text_content.size());
     ctx.drawText(Vec2{ static_cast<int>(ctx.getSize().x - (file_size.size() + 2)), 0 }, file_size);
     const chrono::duration<float> since_last_edit = chrono::steady_clock::now() - last_change;
@@ -61,46 +72,33 @@ void EditorDrawable::render(Context& ctx)
         ctx.draw({ ctx.getSize().x - 1, 0 }, 0x03);
     ctx.drawBox({ text_box_left, text_box_top }, text_box_size);
         
-    // text content
-    int actual_line = scroll + 1;
-    for (int i = scroll; i < static_cast<int>(lines.size()); ++i)
+    // text content, in one or two panes
+    if (split_view)
     {
-        if (i - scroll > text_content_height - 1)
-            continue;
-        ctx.drawText(Vec2{ text_left, i + text_top - scroll }, lines[i].first);
-        if (show_line_checker)
-            ctx.draw(Vec2{ 0, i + text_top - scroll }, (actual_line % 2) ? 0xB0 : 0xB2, 2);
-        if (lines[i].second)
-            ++actual_line;
-    }
+        const int upper_height = getPaneHeight(false);
+        const int lower_height = getPaneHeight(true);
+        const int divider = text_top + upper_height;
+        ctx.draw(Vec2{ text_box_left, divider }, 0xC3);
+        ctx.fill(Vec2{ text_box_left + 1, divider }, Vec2{ text_box_size.x - 2, 1 }, 0xC4);
+        ctx.draw(Vec2{ text_box_right - 1, divider }, 0xB4);
 
-    // cursor and selection
-    if (popup_state == INACTIVE || popup_index == FIND)
-    {
-        if (doc.parsing_error_position != (size_t)-1)
+        const size_t other_cursor = min(anchors.getOffset(other_pane.cursor), text_content.size());
+        const size_t other_selection_end = min(anchors.getOffset(other_pane.selection_end), text_content.size());
+        const Vec2 upper_origin = { text_left, text_top };
+        const Vec2 lower_origin = { text_left, divider + 1 };
+        if (lower_pane_active)
         {
-            ctx.drawColour(calculatePosition(doc.parsing_error_position) + Vec2{ text_left, text_top - scroll }, BG_RED | FG_BLACK);
+            drawPane(ctx, upper_origin, Vec2{ text_content_width, upper_height }, other_cursor, other_selection_end, other_pane.scroll, false);
+            drawPane(ctx, lower_origin, Vec2{ text_content_width, lower_height }, cursor_index, selection_end_index, scroll, true);
         }
-        
-        if (selection_end_index != cursor_index)
+        else
         {
-            Vec2 selection_pos = selection_end_position;
-            Vec2 end_pos = cursor_position;
-            if (cursor_index < selection_end_index)
-            {
-                selection_pos = cursor_position;
-                end_pos = selection_end_position;
-            }
-            while (selection_pos.y != end_pos.y)
-            {
-                ctx.fillColour(selection_pos + Vec2{ text_left, text_top - scroll }, Vec2{ text_content_width - selection_pos.x, 1 }, 2);
-                ++selection_pos.y;
-                selection_pos.x = 0;
-            }
-            ctx.fillColour(selection_pos + Vec2{ text_left, text_top - scroll }, Vec2{ end_pos.x - selection_pos.x + 1, 1 }, 2);
+            drawPane(ctx, upper_origin, Vec2{ text_content_width, upper_height }, cursor_index, selection_end_index, scroll, true);
+            drawPane(ctx, lower_origin, Vec2{ text_content_width, lower_height }, other_cursor, other_selection_end, other_pane.scroll, false);
         }
-        ctx.drawColour(cursor_position + Vec2{ text_left, text_top - scroll }, 1);
     }
+    else
+        drawPane(ctx, Vec2{ text_left, text_top }, Vec2{ text_content_width, text_content_height }, cursor_index, selection_end_index, scroll, true);
 
     // scrollbar
     pushSubtextPalette(ctx);
@@ -125,10 +123,13 @@ void EditorDrawable::render(Context& ctx)
     ctx.drawText({ 1, text_box_bottom }, info_text, 0, 0, enable_animations ? info_text_limit : -1);
     if (enable_animations)
         info_text_limit = min(info_text_limit + 8, info_text.size());
-    const string words_count = to_string(countWords()) + " words.";
+    const string words_count = to_string(text_stats.getWords()) + " words, " + to_string(text_stats.getCharacters()) + " chars, " + to_string(text_stats.getLines()) + " lines.";
     ctx.drawText(Vec2{ ctx.getSize().x - static_cast<int>(words_count.size() + 1), text_box_bottom }, words_count);
     if (show_hints)
-        ctx.drawText({ 1, text_box_bottom + 1 }, "(Ctrl + H)elp  (F)igure  (C)itation  (B)old  (I)talic  (M)ath  (X)code  (S)ection  (R)eference section");
+    {
+        const string context_hint = getContextHint();
+        ctx.drawText({ 1, text_box_bottom + 1 }, context_hint.empty() ? "(Ctrl + H)elp  (F)igure  (C)itation  (B)old  (I)talic  (M)ath  (X)code  (S)ection  (R)eference section" : context_hint);
+    }
     ctx.popPalette();
     
     if (popup_state != INACTIVE && popup_index != FIND)
@@ -150,6 +151,9 @@ void EditorDrawable::render(Context& ctx)
             size.y = 8;
             break;
         case FIND:
+            size.y = 7;
+            break;
+        case RENAME:
             size.y = 5;
             break;
         case SPLASH:
@@ -205,6 +209,11 @@ void EditorDrawable::render(Context& ctx)
             case SETTINGS: drawPopupSettings(ctx); break;
             case FIND: drawPopupFind(ctx); break;
             case PICKER: drawPopupPicker(ctx); break;
+            case DIAGNOSTICS: drawPopupDiagnostics(ctx); break;
+            case RENAME: drawPopupRename(ctx); break;
+            case OUTLINE: drawPopupOutline(ctx); break;
+            case DOCUMENTS: drawPopupDocuments(ctx); break;
+            case FOLDER_SEARCH: drawPopupFolderSearch(ctx); break;
             default: break;
             }
             pushButtonPalette(ctx);
@@ -218,6 +227,200 @@ void EditorDrawable::render(Context& ctx)
     ctx.popPalette();
 }
 
+string EditorDrawable::getContextHint() const
+{
+    const TagInterval* interval = getTagAtCursor();
+    if (interval == nullptr || interval->schema >= tag_schema_count)
+        return "";
+    const Tag& tag = doc->tags[interval->tag];
+    const TagSchema& schema = tag_schemas[interval->schema];
+    if (schema.id_role == ID_NONE || !tag.params.contains("id"))
+        return "'" + tag.type + "' tag";
+
+    const string& id = tag.params.at("id");
+    const IdEntry* entry = doc->ids.find(id);
+    if (schema.id_role == ID_DEFINES)
+        return "'" + tag.type + "' " + id + ", " + to_string(entry ? entry->references.size() : 0) + " references  (Ctrl + G)o to next reference  (Ctrl + R)ename";
+    if (entry == nullptr || !entry->isDefined())
+        return "reference to undefined id '" + id + "'";
+    const Tag& target = doc->tags[doc->tag_intervals.findAt(entry->definition.tag_offset)->tag];
+    const string detail = target.params.contains("image") ? target.params.at("image") : "";
+    return "reference to '" + target.type + "' " + id + (detail.empty() ? "" : " " + detail) + "  (Ctrl + G)o to definition  (Ctrl + R)ename";
+}
+
+void EditorDrawable::drawPane(Context& ctx, const Vec2 text_origin, const Vec2 text_size, const size_t cursor, const size_t selection_end, const int pane_scroll, const bool focused) const
+{
+    const int text_left = text_origin.x;
+    const int text_top = text_origin.y;
+    const int text_content_width = text_size.x;
+    const int text_content_height = text_size.y;
+
+    int actual_line = pane_scroll + 1;
+    for (int i = pane_scroll; i < static_cast<int>(lines.size()) && i - pane_scroll < text_content_height; ++i)
+    {
+        ctx.drawText(Vec2{ text_left, i + text_top - pane_scroll }, lines[i].text, (lines[i].folded > 0) ? 1 : 0);
+        if (show_line_checker)
+            ctx.draw(Vec2{ 0, i + text_top - pane_scroll }, (actual_line % 2) ? 0xB0 : 0xB2, 2);
+        if (lines[i].ends_paragraph)
+            ++actual_line;
+    }
+    if (show_line_checker)
+    {
+        for (size_t slot = 0; slot < bookmarks.size(); ++slot)
+        {
+            if (!anchors.isValid(bookmarks[slot]))
+                continue;
+            const int row = calculatePosition(min(anchors.getOffset(bookmarks[slot]), text_content.size())).y - pane_scroll;
+            if (row >= 0 && row < text_content_height)
+                ctx.draw(Vec2{ 0, row + text_top }, '0' + static_cast<char>(slot), 1);
+        }
+    }
+
+    // cursor and selection
+    if (popup_state != INACTIVE && popup_index != FIND)
+        return;
+    drawHighlighting(ctx, text_origin, text_content_height, pane_scroll);
+
+    if (find_matches.isActive())
+    {
+        // matches can run across rows, so each row picks up any that started just before it. regex
+        // and folded matches can be any length, but never start before their paragraph
+        const vector<size_t>& matches = find_matches.getMatches();
+        const size_t length = find_matches.getNeedle().size();
+        for (int row = pane_scroll; row < static_cast<int>(lines.size()) && row - pane_scroll < text_content_height; ++row)
+        {
+            if (lines[row].folded > 0)
+                continue;
+            const size_t row_start = lines[row].start;
+            const size_t row_end = row_start + lines[row].getColumns();
+            size_t lookback = (row_start >= length) ? row_start - length + 1 : 0;
+            if (find_matches.hasLineMatches())
+            {
+                const size_t newline = (row_start > 0) ? text_content.rfind('\n', row_start - 1) : string::npos;
+                lookback = (newline == string::npos) ? 0 : newline + 1;
+            }
+            for (size_t m = find_matches.findFirst(lookback); m < matches.size() && matches[m] < row_end; ++m)
+            {
+                for (size_t x = max(matches[m], row_start); x < min(matches[m] + find_matches.getLength(m), row_end); ++x)
+                    ctx.drawColour(Vec2{ text_left + static_cast<int>(x - row_start), text_top + row - pane_scroll }, BG_DARK_CYAN | FG_BLACK);
+            }
+        }
+    }
+
+    const Vec2 cursor_pos = calculatePosition(cursor);
+    if (selection_end != cursor)
+    {
+        Vec2 selection_pos = calculatePosition(selection_end);
+        Vec2 end_pos = cursor_pos;
+        if (cursor < selection_end)
+            swap(selection_pos, end_pos);
+        // rows scrolled out of this pane are clipped
+        while (selection_pos.y != end_pos.y)
+        {
+            if (selection_pos.y >= pane_scroll && selection_pos.y - pane_scroll < text_content_height)
+                ctx.fillColour(selection_pos + Vec2{ text_left, text_top - pane_scroll }, Vec2{ text_content_width - selection_pos.x, 1 }, 2);
+            ++selection_pos.y;
+            selection_pos.x = 0;
+        }
+        if (selection_pos.y >= pane_scroll && selection_pos.y - pane_scroll < text_content_height)
+            ctx.fillColour(selection_pos + Vec2{ text_left, text_top - pane_scroll }, Vec2{ end_pos.x - selection_pos.x + 1, 1 }, 2);
+    }
+    // the unfocused pane's cursor is drawn dimmer
+    if (cursor_pos.y >= pane_scroll && cursor_pos.y - pane_scroll < text_content_height)
+        ctx.drawColour(cursor_pos + Vec2{ text_left, text_top - pane_scroll }, focused ? 1 : 2);
+    if (focused)
+        drawCompletions(ctx, text_origin, pane_scroll, text_content_height);
+}
+
+void EditorDrawable::drawCompletions(Context& ctx, const Vec2 text_origin, const int pane_scroll, const int visible_rows) const
+{
+    if (completions.empty())
+        return;
+    // a small list under the word being completed, or above it if there isn't room
+    const Vec2 anchor = calculatePosition(completion_start) - Vec2{ 0, pane_scroll };
+    if (anchor.y < 0 || anchor.y >= visible_rows)
+        return;
+    const int count = static_cast<int>(completions.size());
+    const int first_row = (anchor.y + count < visible_rows) ? anchor.y + 1 : anchor.y - count;
+    size_t width = 0;
+    for (const string& completion : completions)
+        width = max(width, completion.size());
+    for (int i = 0; i < count; ++i)
+    {
+        string entry = " " + completions[i];
+        entry.resize(width + 2, ' ');
+        ctx.drawText(text_origin + Vec2{ anchor.x, first_row + i }, entry, (i == 0) ? 1 : 2);
+    }
+    pushSubtextPalette(ctx);
+    ctx.drawText(text_origin + Vec2{ anchor.x + static_cast<int>(width) + 3, first_row }, "(Tab)");
+    ctx.popPalette();
+}
+
+void EditorDrawable::drawHighlighting(Context& ctx, const Vec2 text_origin, const int visible_rows, const int pane_scroll) const
+{
+    if (!edit_log.canMap(doc->version) || pane_scroll >= static_cast<int>(lines.size()))
+        return;
+    const int last_row = min(pane_scroll + visible_rows, static_cast<int>(lines.size()));
+
+    static const decltype(BG_BLACK | FG_DARK_YELLOW) node_colours[] = {
+        BG_BLACK | FG_DARK_YELLOW,  // text
+        BG_BLACK | FG_YELLOW,       // bold
+        BG_BLACK | FG_DARK_CYAN,    // italic
+        BG_BLACK | FG_RED,          // header
+        BG_BLACK | FG_DARK_GREEN    // tag
+    };
+    const DocumentNodes& nodes = doc->nodes;
+    vector<uint8_t> kinds;
+
+    // rows are taken in runs between folds, so nothing hidden behind a placeholder is looked at
+    int run_first = pane_scroll;
+    while (run_first < last_row)
+    {
+        if (lines[run_first].folded > 0)
+        {
+            ++run_first;
+            continue;
+        }
+        int run_last = run_first;
+        while (run_last + 1 < last_row && lines[run_last + 1].folded == 0)
+            ++run_last;
+        const size_t run_start = lines[run_first].start;
+        const size_t run_end = lines[run_last].start + lines[run_last].getColumns();
+
+        // paint node kinds over the run. children follow their parents, so they take priority. the
+        // generation may be a few edits behind, so node offsets are moved forward to the buffer
+        kinds.assign(run_end - run_start, NODE_TEXT);
+        const size_t doc_run_start = toDocOffset(run_start);
+        const size_t doc_run_end = toDocOffset(run_end);
+        for (size_t n = nodes.findFirstOverlapping(doc_run_start); n < nodes.size() && nodes.start[n] < doc_run_end; ++n)
+        {
+            if (nodes.kind[n] == NODE_TEXT)
+                continue;
+            const size_t from = max(toBufferOffset(nodes.start[n]), run_start);
+            const size_t to = min(toBufferOffset(nodes.start[n] + nodes.length[n]), run_end);
+            if (to > from)
+                fill(kinds.begin() + static_cast<ptrdiff_t>(from - run_start), kinds.begin() + static_cast<ptrdiff_t>(to - run_start), nodes.kind[n]);
+        }
+        for (int row = run_first; row <= run_last; ++row)
+        {
+            const size_t row_start = lines[row].start - run_start;
+            for (size_t x = 0; x < lines[row].getColumns(); ++x)
+            {
+                const uint8_t kind = kinds[row_start + x];
+                if (kind != NODE_TEXT)
+                    ctx.drawColour(text_origin + Vec2{ static_cast<int>(x), row - pane_scroll }, node_colours[kind]);
+            }
+        }
+
+        // diagnostics are sorted, so only the ones in this run need looking at
+        auto it = lower_bound(doc->diagnostics.begin(), doc->diagnostics.end(), doc_run_start,
+                              [](const Diagnostic& d, size_t offset) { return d.position < offset; });
+        for (; it != doc->diagnostics.end() && it->position <= doc_run_end; ++it)
+            ctx.drawColour(calculatePosition(toBufferOffset(it->position)) + text_origin - Vec2{ 0, pane_scroll }, (it->severity == SEVERITY_ERROR) ? (BG_RED | FG_BLACK) : (BG_DARK_YELLOW | FG_BLACK));
+        run_first = run_last + 1;
+    }
+}
+
 void EditorDrawable::pushTitlePalette(Context& ctx)
 {
     ctx.pushPalette(Palette{
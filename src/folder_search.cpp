@@ -0,0 +1,233 @@
+#include "folder_search.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "thread_pool.h"
+
+using namespace std;
+
+// a read-only view of a whole file. empty if it couldn't be opened, or has nothing in it
+class MappedFile
+{
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const filesystem::path& path)
+    {
+#if defined(_WIN32)
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER file_size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+            return;
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+            return;
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data != nullptr)
+            size = static_cast<size_t>(file_size.QuadPart);
+#else
+        const int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return;
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+        {
+            void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (view != MAP_FAILED)
+            {
+                data = static_cast<const char*>(view);
+                size = static_cast<size_t>(status.st_size);
+            }
+        }
+        // the mapping holds its own reference to the file
+        close(descriptor);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#if defined(_WIN32)
+        if (data != nullptr)
+            UnmapViewOfFile(data);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (data != nullptr)
+            munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    string_view getText() const { return (data == nullptr) ? string_view() : string_view(data, size); }
+};
+
+FolderSearch::FolderSearch() :
+    FolderSearch(ThreadPool::getShared())
+{ }
+
+FolderSearch::FolderSearch(ThreadPool& thread_pool) :
+    pool(&thread_pool)
+{ }
+
+FolderSearch::~FolderSearch()
+{
+    cancel();
+}
+
+void FolderSearch::setFolder(const filesystem::path& folder)
+{
+    cancel();
+    files.clear();
+    hits.clear();
+    files_done = 0;
+    folder_error.clear();
+
+    // a file which can't be looked at is skipped, but the first thing to go wrong is reported.
+    // the iterator is stepped by hand, as ++ would throw instead
+    auto noteFailure = [this](const error_code& failure)
+    {
+        if (failure && folder_error.empty())
+            folder_error = failure.message();
+    };
+    error_code listing_status;
+    filesystem::directory_iterator entry(folder, listing_status);
+    for (; !listing_status && entry != filesystem::directory_iterator(); entry.increment(listing_status))
+    {
+        error_code file_status;
+        const bool regular = entry->is_regular_file(file_status);
+        noteFailure(file_status);
+        const filesystem::path extension = entry->path().extension();
+        if (regular && (extension == ".tmd" || extension == ".md"))
+            files.push_back(entry->path());
+    }
+    noteFailure(listing_status);
+    sort(files.begin(), files.end());
+}
+
+void FolderSearch::start(const string& pattern, const SearchMode mode)
+{
+    cancel();
+    hits.clear();
+    files_done = 0;
+    error.clear();
+    if (pattern.empty())
+        return;
+    if (mode == SEARCH_REGEX)
+    {
+        const Regex regex(pattern);
+        error = regex.getError();
+        if (!regex.isValid())
+            return;
+    }
+
+    state = make_shared<State>();
+    for (size_t file = 0; file < files.size(); ++file)
+    {
+        BackgroundJob::submit(*pool, state, [path = files[file], file, pattern, mode](State& task_state)
+        {
+            searchFile(path, file, pattern, mode, task_state);
+        });
+    }
+}
+
+void FolderSearch::cancel()
+{
+    BackgroundJob::cancel(state);
+}
+
+void FolderSearch::update()
+{
+    if (!state)
+        return;
+    lock_guard lock(state->mutex);
+    move(state->hits.begin(), state->hits.end(), back_inserter(hits));
+    state->hits.clear();
+    files_done = state->files_done;
+}
+
+void FolderSearch::searchFile(const filesystem::path& path, const size_t file, const string& pattern, const SearchMode mode, State& search_state)
+{
+    const MappedFile mapped(path);
+    const string_view text = mapped.getText();
+    vector<size_t> starts;
+    vector<uint32_t> lengths;
+    if (mode == SEARCH_REGEX)
+    {
+        Regex regex(pattern);
+        vector<Regex::Match> found;
+        regex.findAll(text, 0, text.size(), found);
+        for (const Regex::Match& match : found)
+        {
+            starts.push_back(match.start);
+            lengths.push_back(static_cast<uint32_t>(match.length));
+        }
+    }
+    else if (mode == SEARCH_EXACT)
+    {
+        const TextSearcher searcher(pattern);
+        for (size_t offset = searcher.findNext(text); offset != TextSearcher::npos && starts.size() < max_hits; offset = searcher.findNext(text, offset + 1))
+        {
+            starts.push_back(offset);
+            lengths.push_back(static_cast<uint32_t>(pattern.size()));
+        }
+    }
+    else
+    {
+        // a file is folded whole here, as nothing is kept between searches
+        const FoldMode fold_mode = (mode == SEARCH_IGNORE_CASE) ? FOLD_CASE : FOLD_CASE_AND_ACCENTS;
+        const string needle = FoldedText::fold(pattern, fold_mode)->text;
+        FoldedText::findAll(*FoldedText::fold(text, fold_mode), 0, TextSearcher(needle), needle.size(), starts, lengths);
+    }
+
+    // lines are counted off as the hits go by, so the file is only walked once
+    vector<Hit> found;
+    size_t line = 0;
+    size_t line_start = 0;
+    size_t next_newline = text.find('\n');
+    for (size_t i = 0; i < starts.size() && i < max_hits; ++i)
+    {
+        const size_t start = starts[i];
+        while (next_newline < start)
+        {
+            ++line;
+            line_start = next_newline + 1;
+            next_newline = text.find('\n', line_start);
+        }
+        const size_t line_end = min(next_newline, text.size());
+        const size_t preview_start = (start - line_start > max_preview / 3) ? start - (max_preview / 3) : line_start;
+        string preview(text.substr(preview_start, min(line_end - preview_start, max_preview)));
+        replace_if(preview.begin(), preview.end(), [](char c) { return c == '\t' || c == '\r'; }, ' ');
+        found.push_back(Hit{ file, line, start - line_start, lengths[i], std::move(preview) });
+    }
+
+    lock_guard lock(search_state.mutex);
+    if (search_state.isCancelled())
+        return;
+    const size_t room = max_hits - min(search_state.hit_count, max_hits);
+    if (found.size() > room)
+        found.resize(room);
+    search_state.hit_count += found.size();
+    move(found.begin(), found.end(), back_inserter(search_state.hits));
+    ++search_state.files_done;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "background_job.h"
+#include "match_index.h"
+
+// searches every .tmd and .md file in a folder at once. the folder is only listed when it's set,
+// and each search maps and searches every file by its own task on the shared thread pool. hits
+// come back a file at a time as they're found, so the first results show up long before the last
+// file is done
+class FolderSearch
+{
+public:
+    struct Hit
+    {
+        size_t file;   // into getFiles
+        size_t line;   // from 0
+        size_t column; // in bytes
+        size_t length;
+        std::string preview;
+    };
+
+private:
+    struct State : BackgroundJob
+    {
+        std::vector<Hit> hits; // not yet collected by update
+        size_t files_done = 0;
+        size_t hit_count = 0;
+    };
+
+    ThreadPool* pool;
+    std::shared_ptr<State> state;
+    std::vector<std::filesystem::path> files;
+    std::vector<Hit> hits;
+    size_t files_done = 0;
+    std::string error;        // for the query
+    std::string folder_error; // for listing the folder
+
+    // beyond this the search stops, as nobody is reading through that many
+    static constexpr size_t max_hits = 10000;
+    static constexpr size_t max_preview = 100;
+
+public:
+    FolderSearch();
+    explicit FolderSearch(ThreadPool& thread_pool);
+    ~FolderSearch();
+
+    FolderSearch(FolderSearch&&) noexcept = default;
+    FolderSearch& operator=(FolderSearch&&) noexcept = default;
+
+    // lists the files to search, which are kept for every search until the next call
+    void setFolder(const std::filesystem::path& folder);
+    void start(const std::string& pattern, SearchMode mode);
+    void cancel();
+    // collects whatever the tasks have found since the last call
+    void update();
+
+    const std::vector<std::filesystem::path>& getFiles() const { return files; }
+    const std::vector<Hit>& getHits() const { return hits; }
+    const std::string& getError() const { return error.empty() ? folder_error : error; }
+    bool isRunning() const { return state && files_done < files.size() && hits.size() < max_hits; }
+    size_t getFilesDone() const { return files_done; }
+    bool isTruncated() const { return hits.size() >= max_hits; }
+
+private:
+    static void searchFile(const std::filesystem::path& path, size_t file, const std::string& pattern, SearchMode mode, State& search_state);
+};
@@ -0,0 +1,145 @@
+#include "fuzzy_matcher.h"
+
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+static char toLower(const char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static bool isBoundary(const string& str, const size_t i)
+{
+    if (i == 0)
+        return true;
+    const char previous = str[i - 1];
+    if (previous == '/' || previous == '\\' || previous == '_' || previous == '-' || previous == '.' || previous == ' ')
+        return true;
+    // camelCase
+    return (previous >= 'a' && previous <= 'z') && (str[i] >= 'A' && str[i] <= 'Z');
+}
+
+void FuzzyMatcher::setCandidates(vector<string> new_candidates)
+{
+    candidates = std::move(new_candidates);
+    masks.resize(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i)
+        masks[i] = characterMask(candidates[i]);
+    query.clear();
+    results.clear();
+    for (uint32_t i = 0; i < candidates.size(); ++i)
+        results.emplace_back(i, 0);
+}
+
+void FuzzyMatcher::setQuery(const string& new_query)
+{
+    if (new_query == query)
+        return;
+
+    // anything which failed the old query fails this one too, so only survivors need looking at
+    const bool narrowing = !query.empty() && new_query.starts_with(query);
+    if (!narrowing)
+    {
+        results.clear();
+        for (uint32_t i = 0; i < candidates.size(); ++i)
+            results.emplace_back(i, 0);
+    }
+    query = new_query;
+    if (query.empty())
+        return;
+
+    const uint64_t query_mask = characterMask(query);
+    size_t kept = 0;
+    for (const Result& result : results)
+    {
+        if ((masks[result.index] & query_mask) != query_mask)
+            continue;
+        const int s = score(candidates[result.index], query);
+        if (s != INT_MIN)
+            results[kept++] = { result.index, s };
+    }
+    results.resize(kept);
+    rank();
+}
+
+int FuzzyMatcher::score(const string& candidate, const string& pattern)
+{
+    if (pattern.empty())
+        return 0;
+
+    // find where the earliest complete match ends, then walk back from there for the shortest
+    // window that still contains it
+    size_t p = 0;
+    size_t end = 0;
+    for (; end < candidate.size(); ++end)
+    {
+        if (toLower(candidate[end]) == toLower(pattern[p]) && ++p == pattern.size())
+            break;
+    }
+    if (p < pattern.size())
+        return INT_MIN;
+    size_t start = end;
+    p = pattern.size();
+    for (size_t i = end + 1; i-- > 0;)
+    {
+        if (toLower(candidate[i]) == toLower(pattern[p - 1]) && --p == 0)
+        {
+            start = i;
+            break;
+        }
+    }
+
+    // matching characters score, more so at word boundaries and in runs. gaps cost a little
+    int total = 0;
+    size_t last_match = start;
+    p = 0;
+    for (size_t i = start; i <= end && p < pattern.size(); ++i)
+    {
+        if (toLower(candidate[i]) != toLower(pattern[p]))
+            continue;
+        total += 16;
+        if (isBoundary(candidate, i))
+            total += 8;
+        if (p > 0 && i == last_match + 1)
+            total += 6;
+        else if (p > 0)
+            total -= static_cast<int>(min<size_t>(i - last_match - 1, 8));
+        if (candidate[i] == pattern[p])
+            ++total;
+        last_match = i;
+        ++p;
+    }
+    // prefer matches near the start, then shorter candidates
+    total -= static_cast<int>(min<size_t>(start, 16));
+    return total;
+}
+
+uint64_t FuzzyMatcher::characterMask(const string& str)
+{
+    uint64_t mask = 0;
+    for (const char raw : str)
+    {
+        const char c = toLower(raw);
+        if (c >= 'a' && c <= 'z')
+            mask |= 1ull << (c - 'a');
+        else if (c >= '0' && c <= '9')
+            mask |= 1ull << (26 + c - '0');
+        else
+            mask |= 1ull << (36 + (static_cast<unsigned char>(c) % 28));
+    }
+    return mask;
+}
+
+void FuzzyMatcher::rank()
+{
+    stable_sort(results.begin(), results.end(), [this](const Result& a, const Result& b)
+    {
+        if (a.score != b.score)
+            return a.score > b.score;
+        if (candidates[a.index].size() != candidates[b.index].size())
+            return candidates[a.index].size() < candidates[b.index].size();
+        return a.index < b.index;
+    });
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ranks candidate strings against a query typed one character at a time. a query matches if
+// its characters appear in order (ignoring case). each candidate has a bitmask of the characters
+// it contains, so most non-matches are rejected with a single AND, and since a longer query can
+// only match a subset of what the shorter one did, extending the query only re-scores survivors
+class FuzzyMatcher
+{
+public:
+    struct Result
+    {
+        uint32_t index;
+        int score;
+    };
+
+private:
+    std::vector<std::string> candidates;
+    std::vector<uint64_t> masks;
+    std::string query;
+    std::vector<Result> results;
+
+public:
+    void setCandidates(std::vector<std::string> new_candidates);
+    void setQuery(const std::string& new_query);
+    const std::string& getQuery() const { return query; }
+    const std::vector<Result>& getResults() const { return results; }
+    const std::string& getCandidate(uint32_t index) const { return candidates[index]; }
+
+    // INT_MIN if the query doesn't match at all
+    static int score(const std::string& candidate, const std::string& pattern);
+
+private:
+    static uint64_t characterMask(const std::string& str);
+    void rank();
+};
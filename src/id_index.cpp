@@ -0,0 +1,69 @@
+#include "id_index.h"
+
+using namespace std;
+
+static constexpr uint32_t EMPTY_SLOT = 0;
+
+IdEntry& IdIndex::insert(string_view id)
+{
+    // keep the table at most half full so probe sequences stay short
+    if ((entries.size() + 1) * 2 > slots.size())
+        grow();
+
+    const size_t slot = findSlot(id);
+    if (slots[slot] != EMPTY_SLOT)
+        return entries[slots[slot] - 1];
+
+    entries.emplace_back();
+    entries.back().id = id;
+    slots[slot] = static_cast<uint32_t>(entries.size());
+    return entries.back();
+}
+
+const IdEntry* IdIndex::find(string_view id) const
+{
+    if (slots.empty())
+        return nullptr;
+    const size_t slot = findSlot(id);
+    return (slots[slot] == EMPTY_SLOT) ? nullptr : &entries[slots[slot] - 1];
+}
+
+void IdIndex::clear()
+{
+    entries.clear();
+    slots.clear();
+}
+
+size_t IdIndex::findSlot(string_view id) const
+{
+    const size_t mask = slots.size() - 1;
+    size_t slot = hash(id) & mask;
+    while (slots[slot] != EMPTY_SLOT && entries[slots[slot] - 1].id != id)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+void IdIndex::grow()
+{
+    slots.assign(max(slots.size() * 2, (size_t)16), EMPTY_SLOT);
+    const size_t mask = slots.size() - 1;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        size_t slot = hash(entries[i].id) & mask;
+        while (slots[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & mask;
+        slots[slot] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+size_t IdIndex::hash(string_view id)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for (const char c : id)
+    {
+        h ^= static_cast<uint8_t>(c);
+        h *= 1099511628211ull;
+    }
+    return static_cast<size_t>(h);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct IdOccurrence
+{
+    size_t tag_offset;
+    size_t value_offset;
+    size_t schema;
+};
+
+struct IdEntry
+{
+    std::string id;
+    IdOccurrence definition = { (size_t)-1, (size_t)-1, (size_t)-1 };
+    std::vector<IdOccurrence> references;
+    // further definitions of the same id, which are reported as errors
+    std::vector<IdOccurrence> duplicates;
+
+    bool isDefined() const { return definition.tag_offset != (size_t)-1; }
+};
+
+// maps ids to their definition and references. entries live in one flat array, looked up
+// through an open-addressed table of indices
+class IdIndex
+{
+private:
+    std::vector<IdEntry> entries;
+    std::vector<uint32_t> slots;
+
+public:
+    IdEntry& insert(std::string_view id);
+    const IdEntry* find(std::string_view id) const;
+    bool contains(std::string_view id) const { return find(id) != nullptr; }
+    const std::vector<IdEntry>& getEntries() const { return entries; }
+    void clear();
+
+private:
+    size_t findSlot(std::string_view id) const;
+    void grow();
+    static size_t hash(std::string_view id);
+};
@@ -0,0 +1,57 @@
+#include "interval_index.h"
+
+#include <algorithm>
+
+#include "document.h"
+#include "tag_schema.h"
+
+using namespace std;
+
+void IntervalIndex::build(const vector<Tag>& tags)
+{
+    intervals.clear();
+    by_schema.assign(tag_schema_count, { });
+    intervals.reserve(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i)
+    {
+        const Tag& tag = tags[i];
+        const TagInterval interval = { tag.start_offset, tag.start_offset + tag.size + 1, static_cast<uint32_t>(i), static_cast<uint32_t>(findTagSchema(tag.type)) };
+        intervals.push_back(interval);
+        if (interval.schema < tag_schema_count)
+            by_schema[interval.schema].push_back(interval);
+    }
+}
+
+const TagInterval* IntervalIndex::findAt(size_t offset) const
+{
+    // tags never overlap, so only the last one starting at or before the offset can contain it
+    auto it = upper_bound(intervals.begin(), intervals.end(), offset, [](size_t o, const TagInterval& t) { return o < t.start; });
+    if (it == intervals.begin())
+        return nullptr;
+    --it;
+    return (offset <= it->end) ? &(*it) : nullptr;
+}
+
+const TagInterval* IntervalIndex::findNext(size_t offset, uint32_t schema) const
+{
+    const auto& list = getList(schema);
+    auto it = upper_bound(list.begin(), list.end(), offset, [](size_t o, const TagInterval& t) { return o < t.start; });
+    return (it == list.end()) ? nullptr : &(*it);
+}
+
+const TagInterval* IntervalIndex::findPrevious(size_t offset, uint32_t schema) const
+{
+    const auto& list = getList(schema);
+    auto it = lower_bound(list.begin(), list.end(), offset, [](const TagInterval& t, size_t o) { return t.end <= o; });
+    // the first one that doesn't end before the offset, so step back to the one before it
+    if (it == list.begin())
+        return nullptr;
+    return &(*(it - 1));
+}
+
+const vector<TagInterval>& IntervalIndex::getList(uint32_t schema) const
+{
+    if (schema == ANY_SCHEMA || schema >= by_schema.size())
+        return intervals;
+    return by_schema[schema];
+}
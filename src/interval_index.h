@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Tag;
+
+struct TagInterval
+{
+    size_t start;
+    size_t end;
+    uint32_t tag;
+    uint32_t schema;
+};
+
+// sorted spans of every tag in a document, with a separate list per tag type so typed
+// next/previous queries don't have to skip over other tags
+class IntervalIndex
+{
+private:
+    std::vector<TagInterval> intervals;
+    std::vector<std::vector<TagInterval>> by_schema;
+
+public:
+    static constexpr uint32_t ANY_SCHEMA = -1;
+
+    void build(const std::vector<Tag>& tags);
+    // includes the position just after the closing brace, where the cursor sits after typing it
+    const TagInterval* findAt(size_t offset) const;
+    const TagInterval* findNext(size_t offset, uint32_t schema = ANY_SCHEMA) const;
+    const TagInterval* findPrevious(size_t offset, uint32_t schema = ANY_SCHEMA) const;
+    size_t size() const { return intervals.size(); }
+
+private:
+    const std::vector<TagInterval>& getList(uint32_t schema) const;
+};
@@ -0,0 +1,482 @@
+#include "match_index.h"
+
+#include <algorithm>
+
+#include "text_search.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+MatchIndex::MatchIndex() :
+    MatchIndex(ThreadPool::getShared())
+{ }
+
+MatchIndex::MatchIndex(ThreadPool& thread_pool) :
+    pool(&thread_pool)
+{ }
+
+MatchIndex::~MatchIndex()
+{
+    cancelBuild();
+}
+
+void MatchIndex::search(const string_view pattern, const string_view buffer, const SearchMode search_mode)
+{
+    needle = pattern;
+    mode = search_mode;
+    matches.clear();
+    lengths.clear();
+    error.clear();
+    regex.reset();
+    folded_needle.clear();
+    dirty.clear();
+    levels.clear();
+    narrowing = false;
+    needs_rebuild = false;
+    cancelBuild();
+    if (needle.empty())
+        return;
+    if (mode == SEARCH_REGEX)
+    {
+        regex = make_unique<Regex>(needle);
+        error = regex->getError();
+        if (!regex->isValid())
+            return;
+    }
+    else if (mode != SEARCH_EXACT)
+    {
+        folded_needle = FoldedText::fold(needle, getFoldMode(mode))->text;
+        if (!scope.isActive())
+            shadow.prepare(buffer, getFoldMode(mode));
+    }
+    startBuild(buffer);
+}
+
+void MatchIndex::setQuery(const string_view pattern, const string_view buffer, const SearchMode search_mode)
+{
+    if (pattern == needle && search_mode == mode)
+        return;
+    if (search_mode != SEARCH_EXACT || mode != SEARCH_EXACT || scope.isActive())
+    {
+        search(pattern, buffer, search_mode);
+        return;
+    }
+    // only finished results are worth keeping. the levels form a chain of prefixes, so anything
+    // which isn't a prefix of the new query is dropped from the end
+    if (isReady() && !needle.empty())
+        levels.push_back(Level{ std::move(needle), std::move(matches) });
+    while (!levels.empty() && !pattern.starts_with(levels.back().needle))
+        levels.pop_back();
+
+    needle = pattern;
+    matches.clear();
+    dirty.clear();
+    narrowing = false;
+    needs_rebuild = false;
+    cancelBuild();
+    if (levels.empty())
+    {
+        if (!needle.empty())
+            startBuild(buffer);
+    }
+    else if (levels.back().needle.size() == needle.size())
+    {
+        matches = std::move(levels.back().matches);
+        levels.pop_back();
+    }
+    else
+    {
+        narrowing = true;
+        narrow_next = 0;
+    }
+}
+
+void MatchIndex::clear()
+{
+    scope.clear();
+    search("", "");
+}
+
+void MatchIndex::resetBuffer()
+{
+    text_index.reset();
+    shadow.clear();
+    scope.clear();
+}
+
+void MatchIndex::setScope(vector<pair<size_t, size_t>> ranges, const string_view buffer)
+{
+    // every parse sets it again, which mostly changes nothing
+    if (scope.isActive() && scope.getRanges() == ranges)
+        return;
+    scope.set(std::move(ranges));
+    search(string(needle), buffer, mode);
+}
+
+void MatchIndex::clearScope(const string_view buffer)
+{
+    if (!scope.isActive())
+        return;
+    scope.clear();
+    search(string(needle), buffer, mode);
+}
+
+void MatchIndex::applyEdit(const size_t offset, const size_t removed, const size_t inserted)
+{
+    text_index.reset();
+    if (batching)
+    {
+        batch_edits.push_back(TextEdit{ 0, offset, removed, inserted });
+        return;
+    }
+    shadow.applyEdit(offset, removed, inserted);
+    scope.applyEdit(offset, removed, inserted);
+    if (needle.empty())
+        return;
+    // kept results don't follow edits, only the live one does
+    levels.clear();
+    if (narrowing)
+    {
+        narrowing = false;
+        needs_rebuild = true;
+        return;
+    }
+    if (needs_rebuild)
+        return;
+    if (build)
+    {
+        // the build hasn't seen this one, so it gets replayed when it lands
+        pending_edits.push_back(Edit{ offset, removed, inserted });
+        return;
+    }
+    shiftMatches(Edit{ offset, removed, inserted });
+}
+
+void MatchIndex::endEdits(const string_view buffer)
+{
+    batching = false;
+    if (batch_edits.empty())
+        return;
+    // the shadow would have to be patched once per edit, and is likely all touched anyway, so it's
+    // folded again as needed
+    shadow.clear();
+    scope.applyEdits(batch_edits);
+    batch_edits.clear();
+    search(string(needle), buffer, mode);
+}
+
+void MatchIndex::update(const string_view buffer)
+{
+    if (needs_rebuild)
+    {
+        needs_rebuild = false;
+        startBuild(buffer);
+    }
+    if (narrowing)
+    {
+        narrowStep(buffer);
+        return;
+    }
+    // an edit storm while building would only make the replay slower than starting over. the
+    // restart can be answered by the trigram index straight away, leaving nothing to wait for
+    if (build && pending_edits.size() > max_pending_edits)
+        startBuild(buffer);
+    if (build)
+    {
+        {
+            lock_guard lock(build->mutex);
+            if (!build->finished)
+                return;
+            matches = std::move(build->matches);
+            lengths = std::move(build->lengths);
+            // folded chunks are only still good if nothing has been edited since
+            if (pending_edits.empty())
+                shadow.install(std::move(build->folded));
+        }
+        build.reset();
+        for (const Edit& edit : pending_edits)
+            shiftMatches(edit);
+        pending_edits.clear();
+    }
+    if (!dirty.empty())
+        rescanDirty(buffer);
+}
+
+size_t MatchIndex::findFirst(const size_t offset) const
+{
+    return static_cast<size_t>(lower_bound(matches.begin(), matches.end(), offset) - matches.begin());
+}
+
+void MatchIndex::startBuild(const string_view buffer)
+{
+    cancelBuild();
+    matches.clear();
+    lengths.clear();
+    dirty.clear();
+    if (mode == SEARCH_EXACT && !scope.isActive() && searchIndexed(buffer))
+        return;
+    build = make_shared<Build>();
+    if (scope.isActive())
+    {
+        // only what's in scope gets copied out and looked at
+        vector<pair<size_t, string>> pieces;
+        for (const auto& [start, end] : scope.getRanges())
+            pieces.emplace_back(start, string(buffer.substr(start, end - start)));
+        BackgroundJob::submit(*pool, build, [task_pieces = std::move(pieces), task_needle = (mode == SEARCH_EXACT) ? needle : folded_needle, task_pattern = needle, task_mode = mode](Build& task_build)
+        {
+            const TextSearcher searcher(task_needle);
+            unique_ptr<Regex> task_regex = (task_mode == SEARCH_REGEX) ? make_unique<Regex>(task_pattern) : nullptr;
+            vector<size_t> found;
+            vector<uint32_t> found_lengths;
+            for (const auto& [start, piece] : task_pieces)
+            {
+                if (task_build.isCancelled())
+                    return;
+                const size_t first = found.size();
+                scanRange(piece, 0, piece.size(), piece.size(), task_mode, searcher, task_needle.size(), task_regex.get(), found, found_lengths);
+                for (size_t i = first; i < found.size(); ++i)
+                    found[i] += start;
+            }
+            task_build.finish([&]()
+            {
+                task_build.matches = std::move(found);
+                task_build.lengths = std::move(found_lengths);
+            });
+        });
+        return;
+    }
+    // scanned in slices so a superseded build stops early
+    static constexpr size_t slice = 4 * 1024 * 1024;
+    if (regex)
+    {
+        BackgroundJob::submit(*pool, build, [snapshot = string(buffer), task_needle = needle](Build& task_build)
+        {
+            // the regex's state cache isn't shareable, so the task gets its own. slices end on
+            // newlines, which no match crosses
+            Regex task_regex(task_needle);
+            vector<Regex::Match> found;
+            for (size_t from = 0; from < snapshot.size();)
+            {
+                if (task_build.isCancelled())
+                    return;
+                const size_t newline = snapshot.find('\n', from + slice);
+                const size_t to = (newline == string::npos) ? snapshot.size() : newline + 1;
+                task_regex.findAll(snapshot, from, to, found);
+                from = to;
+            }
+            task_build.finish([&]()
+            {
+                for (const Regex::Match& match : found)
+                {
+                    task_build.matches.push_back(match.start);
+                    task_build.lengths.push_back(static_cast<uint32_t>(match.length));
+                }
+            });
+        });
+        return;
+    }
+    if (mode != SEARCH_EXACT)
+    {
+        // only the chunks the shadow doesn't have yet need copying out to be folded
+        BackgroundJob::submit(*pool, build, [snapshot = shadow.takeSnapshot(buffer), task_needle = folded_needle](Build& task_build)
+        {
+            vector<size_t> found;
+            vector<uint32_t> found_lengths;
+            vector<shared_ptr<const FoldedText::Chunk>> folded;
+            if (!FoldedText::findAll(snapshot, TextSearcher(task_needle), task_needle.size(), found, found_lengths, folded, &task_build.cancelled))
+                return;
+            task_build.finish([&]()
+            {
+                task_build.matches = std::move(found);
+                task_build.lengths = std::move(found_lengths);
+                task_build.folded = std::move(folded);
+            });
+        });
+        return;
+    }
+    BackgroundJob::submit(*pool, build, [snapshot = string(buffer), task_needle = needle](Build& task_build)
+    {
+        const TextSearcher searcher(task_needle);
+        vector<size_t> found;
+        size_t offset = searcher.findNext(snapshot);
+        for (size_t checkpoint = slice; offset != TextSearcher::npos; offset = searcher.findNext(snapshot, offset + 1))
+        {
+            found.push_back(offset);
+            if (offset >= checkpoint)
+            {
+                if (task_build.isCancelled())
+                    return;
+                checkpoint = offset + slice;
+            }
+        }
+        task_build.finish([&]() { task_build.matches = std::move(found); });
+    });
+}
+
+void MatchIndex::cancelBuild()
+{
+    BackgroundJob::cancel(build);
+    pending_edits.clear();
+}
+
+bool MatchIndex::searchIndexed(const string_view buffer)
+{
+    vector<uint32_t> blocks;
+    if (!text_index || text_index->getTextSize() != buffer.size() || !text_index->findCandidateBlocks(needle, blocks))
+        return false;
+    if (blocks.size() * TrigramIndex::block_size > max_indexed_scan)
+        return false;
+
+    // a block is searched for match starts inside it, with the needle free to run on past its end
+    const TextSearcher searcher(needle);
+    for (const uint32_t block : blocks)
+    {
+        const size_t from = block * TrigramIndex::block_size;
+        const size_t to = min(from + TrigramIndex::block_size, buffer.size());
+        const string_view window = buffer.substr(0, min(buffer.size(), to + needle.size() - 1));
+        for (size_t offset = searcher.findNext(window, from); offset != TextSearcher::npos && offset < to; offset = searcher.findNext(window, offset + 1))
+            matches.push_back(offset);
+    }
+    return true;
+}
+
+void MatchIndex::narrowStep(const string_view buffer)
+{
+    // everything in the level already matches its needle, so only the rest of the query is compared.
+    // the clock is only checked every so often, as the comparisons are much cheaper than reading it
+    const Level& base = levels.back();
+    const string_view suffix = string_view(needle).substr(base.needle.size());
+    const auto deadline = chrono::steady_clock::now() + narrow_budget;
+    while (narrow_next < base.matches.size())
+    {
+        const size_t batch_end = min(narrow_next + 4096, base.matches.size());
+        for (; narrow_next < batch_end; ++narrow_next)
+        {
+            const size_t start = base.matches[narrow_next] + base.needle.size();
+            if (buffer.substr(min(start, buffer.size()), suffix.size()) == suffix)
+                matches.push_back(base.matches[narrow_next]);
+        }
+        if (chrono::steady_clock::now() >= deadline)
+            return;
+    }
+    narrowing = false;
+}
+
+void MatchIndex::shiftMatches(const Edit& edit)
+{
+    // anything overlapping the removed range is gone, and anything after it moves. new matches can
+    // only start in the window covering the inserted text and the needle's length before it
+    // (regex and folded matches before the edit are left for the rescan, which covers their whole line)
+    const size_t reach = hasLineMatches() ? 0 : needle.size() - 1;
+    const size_t window_start = (edit.offset > reach) ? edit.offset - reach : 0;
+    eraseMatches(window_start, edit.offset + edit.removed);
+    for (auto it = lower_bound(matches.begin(), matches.end(), window_start); it != matches.end(); ++it)
+        *it = *it + edit.inserted - edit.removed;
+
+    auto move_position = [&](size_t position)
+    {
+        if (position >= edit.offset + edit.removed)
+            return position + edit.inserted - edit.removed;
+        return min(position, edit.offset);
+    };
+    for (auto& [start, end] : dirty)
+    {
+        start = move_position(start);
+        end = max(move_position(end), start);
+    }
+    dirty.emplace_back(window_start, edit.offset + edit.inserted);
+}
+
+void MatchIndex::scanRange(const string_view buffer, const size_t from, const size_t to, const size_t limit, const SearchMode search_mode, const TextSearcher& searcher, const size_t needle_size, Regex* const range_regex, vector<size_t>& starts, vector<uint32_t>& found_lengths)
+{
+    if (search_mode == SEARCH_REGEX)
+    {
+        vector<Regex::Match> regex_found;
+        range_regex->findAll(buffer.substr(0, limit), from, to, regex_found);
+        for (const Regex::Match& match : regex_found)
+        {
+            starts.push_back(match.start);
+            found_lengths.push_back(static_cast<uint32_t>(match.length));
+        }
+    }
+    else if (search_mode != SEARCH_EXACT)
+    {
+        // no match leaves its line, so folding up to the end of the line with to in it is enough
+        const size_t fold_end = min(limit, min(buffer.find('\n', to), buffer.size()));
+        const auto chunk = FoldedText::fold(buffer.substr(from, fold_end - from), getFoldMode(search_mode));
+        const size_t first = starts.size();
+        FoldedText::findAll(*chunk, from, searcher, needle_size, starts, found_lengths);
+        const size_t kept = static_cast<size_t>(lower_bound(starts.begin() + static_cast<ptrdiff_t>(first), starts.end(), to) - starts.begin());
+        starts.resize(kept);
+        found_lengths.resize(kept);
+    }
+    else
+    {
+        const string_view window = buffer.substr(0, min(limit, to + needle_size - 1));
+        for (size_t offset = searcher.findNext(window, from); offset != TextSearcher::npos && offset < to; offset = searcher.findNext(window, offset + 1))
+            starts.push_back(offset);
+    }
+}
+
+void MatchIndex::eraseMatches(const size_t from, const size_t to)
+{
+    const size_t first = findFirst(from);
+    const size_t last = findFirst(to);
+    matches.erase(matches.begin() + static_cast<ptrdiff_t>(first), matches.begin() + static_cast<ptrdiff_t>(last));
+    if (hasLineMatches())
+        lengths.erase(lengths.begin() + static_cast<ptrdiff_t>(first), lengths.begin() + static_cast<ptrdiff_t>(last));
+}
+
+void MatchIndex::rescanDirty(const string_view buffer)
+{
+    if (hasLineMatches())
+    {
+        // anything on a touched line could have changed
+        for (auto& [start, end] : dirty)
+        {
+            start = min(start, buffer.size());
+            const size_t newline = (start > 0) ? buffer.rfind('\n', start - 1) : string_view::npos;
+            start = (newline == string_view::npos) ? 0 : newline + 1;
+            end = min(buffer.find('\n', min(end, buffer.size())), buffer.size());
+        }
+    }
+    sort(dirty.begin(), dirty.end());
+    size_t total = 0;
+    for (const auto& [start, end] : dirty)
+        total += end - start;
+    if (total > max_rescan)
+    {
+        startBuild(buffer);
+        return;
+    }
+
+    const TextSearcher searcher((mode == SEARCH_EXACT) ? needle : folded_needle);
+    size_t covered = 0;
+    for (const auto& [start, end] : dirty)
+    {
+        // ranges can overlap after shifting, so skip whatever the previous one already covered
+        const size_t from = max(start, covered);
+        if (from >= end)
+            continue;
+        covered = end;
+        vector<size_t> found;
+        vector<uint32_t> found_lengths;
+        const size_t needle_size = (mode == SEARCH_EXACT) ? needle.size() : folded_needle.size();
+        if (!scope.isActive())
+            scanRange(buffer, from, end, buffer.size(), mode, searcher, needle_size, regex.get(), found, found_lengths);
+        else
+        {
+            // out of scope text is skipped over, rather than searched and filtered
+            for (auto range = scope.findFirst(from); range != scope.getRanges().end() && range->first < end; ++range)
+                scanRange(buffer, max(from, range->first), min(end, range->second), range->second, mode, searcher, needle_size, regex.get(), found, found_lengths);
+        }
+
+        // drop whatever is already recorded in the range, then splice in what's there now
+        eraseMatches(from, end);
+        const size_t position = findFirst(from);
+        matches.insert(matches.begin() + static_cast<ptrdiff_t>(position), found.begin(), found.end());
+        if (hasLineMatches())
+            lengths.insert(lengths.begin() + static_cast<ptrdiff_t>(position), found_lengths.begin(), found_lengths.end());
+    }
+    dirty.clear();
+}
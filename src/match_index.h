@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "background_job.h"
+#include "regex_search.h"
+#include "search_scope.h"
+#include "text_fold.h"
+#include "trigram_index.h"
+
+enum SearchMode : uint8_t
+{
+    SEARCH_EXACT,
+    SEARCH_IGNORE_CASE,
+    SEARCH_IGNORE_ACCENTS, // and case
+    SEARCH_REGEX
+};
+
+// every offset the search needle occurs at, sorted. the first scan of a buffer runs on the shared
+// thread pool against a snapshot, and edits made meanwhile are replayed over its result. after
+// that, edits only shift the matches around them and mark a window for rescanning, so keeping the
+// index current costs about as much as the edit itself
+class MatchIndex
+{
+private:
+    struct Level
+    {
+        std::string needle;
+        std::vector<size_t> matches;
+    };
+
+    struct Edit
+    {
+        size_t offset;
+        size_t removed;
+        size_t inserted;
+    };
+
+    struct Build : BackgroundJob
+    {
+        std::vector<size_t> matches;
+        std::vector<uint32_t> lengths;
+        std::vector<std::shared_ptr<const FoldedText::Chunk>> folded; // by span, for the shadow to keep
+    };
+
+    ThreadPool* pool;
+    std::string needle;
+    SearchMode mode = SEARCH_EXACT;
+    std::vector<size_t> matches;
+    // regex and folded matches have lengths of their own. no match leaves its line, so an edit
+    // has every line it touches rescanned
+    std::vector<uint32_t> lengths;
+    std::unique_ptr<Regex> regex;  // compiled from needle, for rescanning
+    std::string folded_needle;
+    FoldedText shadow;             // kept between folded queries, and patched by edits
+    std::string error;
+    std::vector<std::pair<size_t, size_t>> dirty; // ranges of match starts to look at again
+    std::vector<Edit> pending_edits;              // made since the running build's snapshot
+    std::shared_ptr<Build> build;
+    // while a literal query is typed, results for its prefixes are kept, shortest first. a longer
+    // query only rechecks the matches of the longest, a bit at a time from update
+    std::vector<Level> levels;
+    bool narrowing = false;     // filtering levels.back() down into matches
+    size_t narrow_next = 0;
+    bool needs_rebuild = false; // an edit landed mid-narrowing, so the levels are useless
+    // answers literal queries with only a few blocks to look at on the spot. dropped on the first edit
+    std::shared_ptr<const TrigramIndex> text_index;
+    SearchScope scope;          // only ever scanned inside, when active
+    bool batching = false;
+    std::vector<TextEdit> batch_edits;
+
+    // past this much dirty text, the whole buffer goes back to the thread pool instead
+    static constexpr size_t max_rescan = 1024 * 1024;
+    static constexpr size_t max_pending_edits = 512;
+    // most text the trigram index can leave to be searched on the spot
+    static constexpr size_t max_indexed_scan = 4 * 1024 * 1024;
+    static constexpr std::chrono::microseconds narrow_budget{ 4000 };
+
+public:
+    MatchIndex();
+    explicit MatchIndex(ThreadPool& thread_pool);
+    ~MatchIndex();
+
+    MatchIndex(MatchIndex&&) noexcept = default;
+    MatchIndex& operator=(MatchIndex&&) noexcept = default;
+
+    // starts over, scanning the whole buffer
+    void search(std::string_view pattern, std::string_view buffer, SearchMode search_mode = SEARCH_EXACT);
+    // for typing: reuses whatever was found for prefixes of the new query
+    void setQuery(std::string_view pattern, std::string_view buffer, SearchMode search_mode = SEARCH_EXACT);
+    void clear();
+    // the buffer was swapped for a different one, so nothing kept about the old one applies
+    void resetBuffer();
+    // both search the current query again, if the scope has changed
+    void setScope(std::vector<std::pair<size_t, size_t>> ranges, std::string_view buffer);
+    void clearScope(std::string_view buffer);
+    // the index must describe the buffer as it is now
+    void setTextIndex(std::shared_ptr<const TrigramIndex> index) { text_index = std::move(index); }
+
+    // call after the buffer changes. the rescan itself waits for update, so it's fine for the
+    // buffer to still be mid-edit
+    void applyEdit(size_t offset, size_t removed, size_t inserted);
+    // a run of edits, like a replace all. matches don't follow them, and the query is searched
+    // again once they're done
+    void beginEdits() { batching = true; }
+    void endEdits(std::string_view buffer);
+    // picks up a finished build and rescans what edits have touched. buffer must be current
+    void update(std::string_view buffer);
+
+    const std::string& getNeedle() const { return needle; }
+    const std::vector<size_t>& getMatches() const { return matches; }
+    size_t getLength(size_t match) const { return hasLineMatches() ? lengths[match] : needle.size(); }
+    SearchMode getMode() const { return mode; }
+    // whether matches have lengths of their own, and are only known not to leave their line
+    bool hasLineMatches() const { return mode != SEARCH_EXACT; }
+    bool isScoped() const { return scope.isActive(); }
+    // why a regex query found nothing, if it didn't compile
+    const std::string& getError() const { return error; }
+    bool isActive() const { return !needle.empty(); }
+    bool isReady() const { return !build && !narrowing && !needs_rebuild && dirty.empty(); }
+    // index of the first match starting at or after offset
+    size_t findFirst(size_t offset) const;
+
+private:
+    void startBuild(std::string_view buffer);
+    void cancelBuild();
+    bool searchIndexed(std::string_view buffer);
+    static FoldMode getFoldMode(SearchMode search_mode) { return (search_mode == SEARCH_IGNORE_CASE) ? FOLD_CASE : FOLD_CASE_AND_ACCENTS; }
+    // appends the matches starting in [from, to) which end by limit. searcher is on the folded
+    // needle for folded modes, and regex is only used in regex mode
+    static void scanRange(std::string_view buffer, size_t from, size_t to, size_t limit, SearchMode search_mode, const TextSearcher& searcher, size_t needle_size, Regex* range_regex, std::vector<size_t>& starts, std::vector<uint32_t>& found_lengths);
+    void narrowStep(std::string_view buffer);
+    void eraseMatches(size_t from, size_t to);
+    void shiftMatches(const Edit& edit);
+    void rescanDirty(std::string_view buffer);
+};
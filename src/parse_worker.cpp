@@ -0,0 +1,60 @@
+#include "parse_worker.h"
+
+#include "thread_pool.h"
+
+using namespace std;
+
+ParseWorker::ParseWorker() :
+    ParseWorker(ThreadPool::getShared())
+{ }
+
+ParseWorker::ParseWorker(ThreadPool& thread_pool) :
+    pool(&thread_pool),
+    state(make_shared<State>())
+{
+    state->latest.store(make_shared<const Document>());
+}
+
+ParseWorker::~ParseWorker()
+{
+    BackgroundJob::cancel(state);
+}
+
+void ParseWorker::request(string content, const uint64_t version)
+{
+    {
+        lock_guard lock(state->mutex);
+        // anything still waiting is stale now, so just replace it
+        state->pending_content = std::move(content);
+        state->pending_version = version;
+        state->has_pending = true;
+        if (state->running)
+            return;
+        state->running = true;
+    }
+    BackgroundJob::submit(*pool, state, [thread_pool = pool](State& worker_state) { drain(*thread_pool, worker_state); }, PRIORITY_URGENT);
+}
+
+void ParseWorker::drain(ThreadPool& thread_pool, State& worker_state)
+{
+    while (!worker_state.isCancelled())
+    {
+        auto result = make_shared<Document>();
+        {
+            lock_guard lock(worker_state.mutex);
+            if (!worker_state.has_pending)
+            {
+                worker_state.running = false;
+                return;
+            }
+            result->content = std::move(worker_state.pending_content);
+            result->version = worker_state.pending_version;
+            worker_state.has_pending = false;
+        }
+        result->parse(thread_pool);
+
+        // requests are handled in order, but don't let an older generation replace a newer one
+        if (result->version > worker_state.latest.load()->version)
+            worker_state.latest.store(std::move(result));
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "background_job.h"
+#include "document.h"
+
+// parses buffer snapshots off the UI thread, in the shared thread pool's urgent lane. only the most
+// recent request is kept, and every finished parse is published as a new immutable document
+// generation. at most one parse per worker is in flight, so generations still come out in order
+class ParseWorker
+{
+private:
+    // a worker that's gone cancels its state, so whatever it left pending is never parsed
+    struct State : BackgroundJob
+    {
+        std::string pending_content;
+        uint64_t pending_version = 0;
+        bool has_pending = false;
+        bool running = false;
+        std::atomic<std::shared_ptr<const Document>> latest;
+    };
+
+    ThreadPool* pool;
+    std::shared_ptr<State> state;
+
+public:
+    ParseWorker();
+    explicit ParseWorker(ThreadPool& thread_pool);
+    ~ParseWorker();
+
+    ParseWorker(ParseWorker&&) noexcept = default;
+    ParseWorker& operator=(ParseWorker&&) noexcept = default;
+
+    void request(std::string content, uint64_t version);
+    std::shared_ptr<const Document> getLatest() const { return state->latest.load(); }
+
+private:
+    static void drain(ThreadPool& thread_pool, State& worker_state);
+};
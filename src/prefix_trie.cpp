@@ -0,0 +1,91 @@
+#include "prefix_trie.h"
+
+using namespace std;
+
+void PrefixTrie::insert(string_view word)
+{
+    if (word.empty())
+        return;
+    uint32_t node = 0;
+    for (const char c : word)
+    {
+        // find the child, or where it belongs in the sorted sibling list
+        uint32_t previous = NO_NODE;
+        uint32_t child = nodes[node].first_child;
+        while (child != NO_NODE && nodes[child].character < c)
+        {
+            previous = child;
+            child = nodes[child].next_sibling;
+        }
+        if (child == NO_NODE || nodes[child].character != c)
+        {
+            const uint32_t created = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(Node{ c });
+            nodes[created].next_sibling = child;
+            if (previous == NO_NODE)
+                nodes[node].first_child = created;
+            else
+                nodes[previous].next_sibling = created;
+            child = created;
+        }
+        node = child;
+    }
+    if (!nodes[node].terminal)
+        ++word_count;
+    nodes[node].terminal = true;
+}
+
+bool PrefixTrie::contains(string_view word) const
+{
+    const uint32_t node = findNode(word);
+    return node != NO_NODE && nodes[node].terminal;
+}
+
+vector<string> PrefixTrie::complete(string_view prefix, size_t limit) const
+{
+    vector<string> out;
+    const uint32_t node = findNode(prefix);
+    if (node == NO_NODE || limit == 0)
+        return out;
+    string word(prefix);
+    collect(node, word, limit, out);
+    return out;
+}
+
+void PrefixTrie::clear()
+{
+    nodes.assign(1, Node{ '\0' });
+    word_count = 0;
+}
+
+uint32_t PrefixTrie::findChild(uint32_t node, char c) const
+{
+    uint32_t child = nodes[node].first_child;
+    while (child != NO_NODE && nodes[child].character < c)
+        child = nodes[child].next_sibling;
+    return (child != NO_NODE && nodes[child].character == c) ? child : NO_NODE;
+}
+
+uint32_t PrefixTrie::findNode(string_view prefix) const
+{
+    uint32_t node = 0;
+    for (const char c : prefix)
+    {
+        node = findChild(node, c);
+        if (node == NO_NODE)
+            return NO_NODE;
+    }
+    return node;
+}
+
+void PrefixTrie::collect(uint32_t node, string& word, size_t limit, vector<string>& out) const
+{
+    if (nodes[node].terminal)
+        out.push_back(word);
+    for (uint32_t child = nodes[node].first_child; child != NO_NODE && out.size() < limit; child = nodes[child].next_sibling)
+    {
+        word.push_back(nodes[child].character);
+        collect(child, word, limit, out);
+        word.pop_back();
+    }
+}
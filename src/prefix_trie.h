@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// words stored as a character trie, with each node's children kept in sorted order. finding
+// the words under a prefix costs O(prefix length) plus the words actually returned
+class PrefixTrie
+{
+private:
+    static constexpr uint32_t NO_NODE = static_cast<uint32_t>(-1);
+
+    struct Node
+    {
+        char character;
+        bool terminal = false;
+        uint32_t first_child = NO_NODE;
+        uint32_t next_sibling = NO_NODE;
+    };
+
+    std::vector<Node> nodes = { Node{ '\0' } };
+    size_t word_count = 0;
+
+public:
+    void insert(std::string_view word);
+    bool contains(std::string_view word) const;
+    // up to limit words starting with prefix, in lexicographic order
+    std::vector<std::string> complete(std::string_view prefix, size_t limit) const;
+    size_t size() const { return word_count; }
+    void clear();
+
+private:
+    uint32_t findChild(uint32_t node, char c) const;
+    uint32_t findNode(std::string_view prefix) const;
+    void collect(uint32_t node, std::string& word, size_t limit, std::vector<std::string>& out) const;
+};
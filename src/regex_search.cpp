@@ -0,0 +1,717 @@
+#include "regex_search.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+Regex::Regex(const string_view pattern)
+{
+    Syntax syntax;
+    size_t i = 0;
+    if (!parseAlternation(pattern, i, syntax))
+        return;
+    if (i < pattern.size())
+    {
+        error = "unmatched ')'";
+        return;
+    }
+
+    forward.start_node = compileProgram(syntax, false);
+    forward.unanchored = true;
+    forward_anchored.start_node = forward.start_node;
+    reverse.start_node = compileProgram(syntax, true);
+    reverse.unanchored = true;
+    if (nodes.size() > max_nodes)
+    {
+        error = "pattern is too large";
+        return;
+    }
+    buildByteClasses();
+    marks.assign(nodes.size(), 0);
+
+    // a zero length match would be found at every position, which is never what's wanted
+    const int32_t initial = getInitial(forward);
+    if (isAccepting(initial))
+    {
+        error = "pattern matches empty text";
+        return;
+    }
+
+    // when a match can only start (or end) with one particular byte, the scans can skip straight
+    // to it, far quicker than the DFA can step over everything in between
+    first_byte = findOnlyLeavingByte(forward);
+    last_byte = findOnlyLeavingByte(reverse);
+    if (last_byte != -1)
+        last_byte_searcher = TextSearcher(string(1, static_cast<char>(last_byte)));
+}
+
+Regex::Match Regex::findNext(const string_view haystack, const size_t from)
+{
+    if (!isValid() || from >= haystack.size())
+        return Match{ };
+
+    // which matches there are on a line depends on where the ones before them ended, so from's line
+    // is worked through from its start
+    const size_t newline = (from == 0) ? string_view::npos : haystack.rfind('\n', from - 1);
+    size_t line_start = (newline == string_view::npos) ? 0 : newline + 1;
+    size_t line_end = min(haystack.find('\n', from), haystack.size());
+    vector<Match> line_matches;
+    findAll(haystack, line_start, line_end, line_matches);
+    const auto after = find_if(line_matches.begin(), line_matches.end(), [from](const Match& m) { return m.start >= from; });
+    if (after != line_matches.end())
+        return *after;
+
+    // past that, the next line with a match on it is the one the earliest ending match is on
+    if (line_end >= haystack.size())
+        return Match{ };
+    const size_t end = findEarliestEnd(haystack, line_end + 1, haystack.size());
+    if (end == npos)
+        return Match{ };
+    line_start = haystack.rfind('\n', end - 1) + 1;
+    line_end = min(haystack.find('\n', end), haystack.size());
+    line_matches.clear();
+    findAll(haystack, line_start, line_end, line_matches);
+    return line_matches.empty() ? Match{ } : line_matches.front();
+}
+
+Regex::Match Regex::findPrevious(const string_view haystack, size_t before)
+{
+    if (!isValid())
+        return Match{ };
+    before = min(before, haystack.size());
+
+    // a line at a time, working back from the one before is on
+    vector<Match> line_matches;
+    while (before > 0)
+    {
+        const size_t newline = haystack.rfind('\n', before - 1);
+        const size_t line_start = (newline == string_view::npos) ? 0 : newline + 1;
+        line_matches.clear();
+        findAll(haystack, line_start, before, line_matches);
+        if (!line_matches.empty())
+            return line_matches.back();
+        if (line_start == 0)
+            break;
+        before = line_start - 1;
+    }
+    return Match{ };
+}
+
+void Regex::findAll(const string_view haystack, size_t from, size_t to, vector<Match>& matches)
+{
+    if (!isValid())
+        return;
+    to = min(to, haystack.size());
+    if (from >= to)
+        return;
+    // no match starting before to can run past the end of its line
+    const size_t scan_end = min(haystack.find('\n', to - 1), haystack.size());
+    vector<size_t> starts;
+    while (from < to)
+    {
+        exhausted.clear();
+        // skip straight to the next line with anything on it, and collect every start on it in one
+        // pass back from its end
+        const size_t end = findEarliestEnd(haystack, from, scan_end);
+        if (end == npos)
+            return;
+        const size_t newline = haystack.rfind('\n', end - 1);
+        const size_t line_start = (newline == string_view::npos) ? 0 : newline + 1;
+        const size_t line_end = min(haystack.find('\n', end), haystack.size());
+        starts.clear();
+        findStarts(haystack, max(from, line_start), line_end, starts);
+        // then the leftmost start is taken, as far as it goes, and the next match can only begin
+        // after it ends. starts come out last to first
+        size_t match_end = 0;
+        for (auto it = starts.rbegin(); it != starts.rend() && *it < to; ++it)
+        {
+            if (*it < match_end)
+                continue;
+            match_end = findLongestEnd(haystack, *it, line_end);
+            matches.push_back(Match{ *it, match_end - *it });
+        }
+        from = line_end + 1;
+    }
+}
+
+bool Regex::parseAlternation(const string_view pattern, size_t& i, Syntax& result)
+{
+    result = Syntax{ Syntax::ALTERNATE };
+    while (true)
+    {
+        Syntax branch;
+        if (!parseConcatenation(pattern, i, branch))
+            return false;
+        result.children.push_back(std::move(branch));
+        if (i >= pattern.size() || pattern[i] != '|')
+            break;
+        ++i;
+    }
+    if (result.children.size() == 1)
+        result = std::move(result.children[0]);
+    return true;
+}
+
+bool Regex::parseConcatenation(const string_view pattern, size_t& i, Syntax& result)
+{
+    result = Syntax{ Syntax::CONCAT };
+    while (i < pattern.size() && pattern[i] != '|' && pattern[i] != ')')
+    {
+        Syntax item;
+        if (!parseRepeat(pattern, i, item))
+            return false;
+        result.children.push_back(std::move(item));
+    }
+    if (result.children.size() == 1)
+        result = std::move(result.children[0]);
+    return true;
+}
+
+static bool parseNumber(const string_view pattern, size_t& i, int& number)
+{
+    const size_t start = i;
+    number = 0;
+    while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9' && number <= 1000)
+        number = (number * 10) + (pattern[i++] - '0');
+    return i > start;
+}
+
+bool Regex::parseRepeat(const string_view pattern, size_t& i, Syntax& result)
+{
+    if (!parseAtom(pattern, i, result))
+        return false;
+    while (i < pattern.size())
+    {
+        int min = 0, max = -1;
+        const char c = pattern[i];
+        if (c == '*')
+            ++i;
+        else if (c == '+')
+        {
+            min = 1;
+            ++i;
+        }
+        else if (c == '?')
+        {
+            max = 1;
+            ++i;
+        }
+        else if (c == '{')
+        {
+            ++i;
+            if (!parseNumber(pattern, i, min))
+            {
+                error = "expected a number after '{'";
+                return false;
+            }
+            max = min;
+            if (i < pattern.size() && pattern[i] == ',')
+            {
+                ++i;
+                if (!parseNumber(pattern, i, max))
+                    max = -1;
+            }
+            if (i >= pattern.size() || pattern[i] != '}')
+            {
+                error = "expected '}'";
+                return false;
+            }
+            ++i;
+            if (min > 1000 || max > 1000 || (max != -1 && max < min))
+            {
+                error = "bad repeat count";
+                return false;
+            }
+        }
+        else
+            break;
+
+        Syntax repeat{ Syntax::REPEAT };
+        repeat.min = min;
+        repeat.max = max;
+        repeat.children.push_back(std::move(result));
+        result = std::move(repeat);
+    }
+    return true;
+}
+
+bool Regex::parseAtom(const string_view pattern, size_t& i, Syntax& result)
+{
+    bitset<256> set;
+    const char c = pattern[i++];
+    switch (c)
+    {
+    case '(':
+        // groups don't capture, so (?: is the same thing
+        if (pattern.substr(i).starts_with("?:"))
+            i += 2;
+        if (!parseAlternation(pattern, i, result))
+            return false;
+        if (i >= pattern.size() || pattern[i] != ')')
+        {
+            error = "missing ')'";
+            return false;
+        }
+        ++i;
+        return true;
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        error = string("nothing to repeat before '") + c + "'";
+        return false;
+    case '^':
+    case '$':
+        error = "anchors aren't supported";
+        return false;
+    case '[':
+        if (!parseClass(pattern, i, set))
+            return false;
+        break;
+    case '.':
+        set.set();
+        break;
+    case '\\':
+        if (!parseEscape(pattern, i, set))
+            return false;
+        break;
+    default:
+        set.set(static_cast<uint8_t>(c));
+        break;
+    }
+    result = Syntax{ Syntax::SET };
+    result.set = addSet(set);
+    return true;
+}
+
+bool Regex::parseClass(const string_view pattern, size_t& i, bitset<256>& set)
+{
+    const bool negated = (i < pattern.size() && pattern[i] == '^');
+    if (negated)
+        ++i;
+    // a ']' straight after the opening is a literal
+    bool first = true;
+    while (i < pattern.size() && (pattern[i] != ']' || first))
+    {
+        first = false;
+        bitset<256> item;
+        uint8_t low = static_cast<uint8_t>(pattern[i++]);
+        if (low == '\\')
+        {
+            if (!parseEscape(pattern, i, item))
+                return false;
+            if (item.count() != 1)
+            {
+                set |= item;
+                continue;
+            }
+            low = 0;
+            while (!item.test(low))
+                ++low;
+        }
+        if (i + 1 < pattern.size() && pattern[i] == '-' && pattern[i + 1] != ']')
+        {
+            const uint8_t high = static_cast<uint8_t>(pattern[i + 1]);
+            i += 2;
+            if (high < low)
+            {
+                error = "bad range in class";
+                return false;
+            }
+            for (unsigned b = low; b <= high; ++b)
+                set.set(b);
+        }
+        else
+            set.set(low);
+    }
+    if (i >= pattern.size())
+    {
+        error = "missing ']'";
+        return false;
+    }
+    ++i;
+    if (negated)
+        set.flip();
+    return true;
+}
+
+bool Regex::parseEscape(const string_view pattern, size_t& i, bitset<256>& set)
+{
+    if (i >= pattern.size())
+    {
+        error = "trailing '\\'";
+        return false;
+    }
+    const char c = pattern[i++];
+    auto addRange = [&set](const char low, const char high)
+    {
+        for (int b = low; b <= high; ++b)
+            set.set(static_cast<uint8_t>(b));
+    };
+    switch (c)
+    {
+    case 'd':
+    case 'D':
+        addRange('0', '9');
+        break;
+    case 'w':
+    case 'W':
+        addRange('0', '9');
+        addRange('a', 'z');
+        addRange('A', 'Z');
+        set.set('_');
+        break;
+    case 's':
+    case 'S':
+        set.set(' ');
+        set.set('\t');
+        set.set('\r');
+        break;
+    case 't':
+        set.set('\t');
+        return true;
+    default:
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        {
+            error = string("unknown escape '\\") + c + "'";
+            return false;
+        }
+        set.set(static_cast<uint8_t>(c));
+        return true;
+    }
+    if (c >= 'A' && c <= 'Z')
+        set.flip();
+    return true;
+}
+
+uint32_t Regex::addSet(bitset<256> set)
+{
+    // newlines end every match
+    set.reset('\n');
+    for (uint32_t i = 0; i < sets.size(); ++i)
+    {
+        if (sets[i] == set)
+            return i;
+    }
+    sets.push_back(set);
+    return static_cast<uint32_t>(sets.size() - 1);
+}
+
+uint32_t Regex::addNode(const NodeType type, const uint32_t set)
+{
+    nodes.push_back(Node{ type, set });
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void Regex::patch(const vector<uint32_t>& holes, const uint32_t target)
+{
+    for (const uint32_t hole : holes)
+    {
+        if (hole & 1)
+            nodes[hole / 2].out1 = target;
+        else
+            nodes[hole / 2].out = target;
+    }
+}
+
+Regex::Fragment Regex::compile(const Syntax& syntax, const bool reversed)
+{
+    // thompson construction. repeats are unrolled, so stop early if that gets out of hand
+    if (nodes.size() > max_nodes)
+    {
+        const uint32_t node = addNode(NODE_EMPTY);
+        return Fragment{ node, { node * 2 } };
+    }
+    switch (syntax.kind)
+    {
+    case Syntax::SET:
+    {
+        const uint32_t node = addNode(NODE_SET, syntax.set);
+        return Fragment{ node, { node * 2 } };
+    }
+    case Syntax::CONCAT:
+    {
+        if (syntax.children.empty())
+        {
+            const uint32_t node = addNode(NODE_EMPTY);
+            return Fragment{ node, { node * 2 } };
+        }
+        // the reverse program matches the same text read backwards
+        Fragment result;
+        for (size_t k = 0; k < syntax.children.size(); ++k)
+        {
+            Fragment next = compile(syntax.children[reversed ? syntax.children.size() - 1 - k : k], reversed);
+            if (k == 0)
+                result = std::move(next);
+            else
+            {
+                patch(result.holes, next.start);
+                result.holes = std::move(next.holes);
+            }
+        }
+        return result;
+    }
+    case Syntax::ALTERNATE:
+    {
+        Fragment result = compile(syntax.children[0], reversed);
+        for (size_t k = 1; k < syntax.children.size(); ++k)
+        {
+            Fragment next = compile(syntax.children[k], reversed);
+            const uint32_t split = addNode(NODE_SPLIT);
+            nodes[split].out = result.start;
+            nodes[split].out1 = next.start;
+            result.start = split;
+            result.holes.insert(result.holes.end(), next.holes.begin(), next.holes.end());
+        }
+        return result;
+    }
+    case Syntax::REPEAT:
+    {
+        const Syntax& child = syntax.children[0];
+        const uint32_t entry = addNode(NODE_EMPTY);
+        Fragment result{ entry, { entry * 2 } };
+        for (int k = 0; k < syntax.min; ++k)
+        {
+            Fragment next = compile(child, reversed);
+            patch(result.holes, next.start);
+            result.holes = std::move(next.holes);
+        }
+        if (syntax.max == -1)
+        {
+            // loop back to a split which either goes round again or leaves
+            Fragment body = compile(child, reversed);
+            const uint32_t split = addNode(NODE_SPLIT);
+            nodes[split].out = body.start;
+            patch(body.holes, split);
+            patch(result.holes, split);
+            result.holes = { split * 2 + 1 };
+        }
+        else
+        {
+            // each optional copy can bail out to the end
+            vector<uint32_t> exits;
+            for (int k = syntax.min; k < syntax.max; ++k)
+            {
+                Fragment body = compile(child, reversed);
+                const uint32_t split = addNode(NODE_SPLIT);
+                nodes[split].out = body.start;
+                patch(result.holes, split);
+                exits.push_back(split * 2 + 1);
+                result.holes = std::move(body.holes);
+            }
+            result.holes.insert(result.holes.end(), exits.begin(), exits.end());
+        }
+        return result;
+    }
+    }
+    return Fragment{ };
+}
+
+uint32_t Regex::compileProgram(const Syntax& syntax, const bool reversed)
+{
+    const Fragment fragment = compile(syntax, reversed);
+    patch(fragment.holes, addNode(NODE_MATCH));
+    return fragment.start;
+}
+
+void Regex::buildByteClasses()
+{
+    // bytes which every set treats the same way can share transitions. each set splits the
+    // classes so far into the bytes inside it and the bytes outside
+    byte_classes.fill(0);
+    class_count = 1;
+    for (const bitset<256>& set : sets)
+    {
+        array<int, 512> remap;
+        remap.fill(-1);
+        size_t next_class = 0;
+        for (size_t b = 0; b < 256; ++b)
+        {
+            int& target = remap[(byte_classes[b] * 2) + (set.test(b) ? 1 : 0)];
+            if (target == -1)
+                target = static_cast<int>(next_class++);
+            byte_classes[b] = static_cast<uint8_t>(target);
+        }
+        class_count = next_class;
+    }
+}
+
+void Regex::addClosure(vector<uint32_t>& set, const uint32_t node)
+{
+    vector<uint32_t> stack = { node };
+    while (!stack.empty())
+    {
+        const uint32_t n = stack.back();
+        stack.pop_back();
+        if (marks[n] == mark_generation)
+            continue;
+        marks[n] = mark_generation;
+        switch (nodes[n].type)
+        {
+        case NODE_SPLIT:
+            stack.push_back(nodes[n].out1);
+            stack.push_back(nodes[n].out);
+            break;
+        case NODE_EMPTY:
+            stack.push_back(nodes[n].out);
+            break;
+        default:
+            set.push_back(n);
+            break;
+        }
+    }
+}
+
+int32_t Regex::addState(DFA& dfa, vector<uint32_t> nfa_states)
+{
+    if (nfa_states.empty())
+        return DEAD;
+    sort(nfa_states.begin(), nfa_states.end());
+    string key(reinterpret_cast<const char*>(nfa_states.data()), nfa_states.size() * sizeof(uint32_t));
+    const auto found = dfa.lookup.find(key);
+    if (found != dfa.lookup.end())
+        return found->second;
+
+    bool accepting = false;
+    for (const uint32_t n : nfa_states)
+        accepting |= (nodes[n].type == NODE_MATCH);
+    const int32_t state = static_cast<int32_t>(dfa.states.size() * class_count * 2) + (accepting ? 1 : 0);
+    dfa.states.push_back(std::move(nfa_states));
+    dfa.transitions.resize(dfa.states.size() * class_count, UNKNOWN);
+    dfa.lookup.emplace(std::move(key), state);
+    return state;
+}
+
+int32_t Regex::getInitial(DFA& dfa)
+{
+    if (dfa.initial == UNKNOWN)
+    {
+        ++mark_generation;
+        vector<uint32_t> initial;
+        addClosure(initial, dfa.start_node);
+        dfa.initial = addState(dfa, std::move(initial));
+    }
+    return dfa.initial;
+}
+
+int32_t Regex::computeTransition(DFA& dfa, int32_t state, const uint8_t byte)
+{
+    if (dfa.states.size() >= max_states)
+    {
+        // start the cache again, keeping only the state being left
+        vector<uint32_t> current = dfa.states[(state >> 1) / class_count];
+        dfa.states.clear();
+        dfa.transitions.clear();
+        dfa.lookup.clear();
+        dfa.initial = UNKNOWN;
+        ++dfa.flushes;
+        state = addState(dfa, std::move(current));
+    }
+
+    ++mark_generation;
+    vector<uint32_t> next;
+    for (const uint32_t n : dfa.states[(state >> 1) / class_count])
+    {
+        if (nodes[n].type == NODE_SET && sets[nodes[n].set].test(byte))
+            addClosure(next, nodes[n].out);
+    }
+    // unanchored searches can start a new match after any byte
+    if (dfa.unanchored)
+        addClosure(next, dfa.start_node);
+    const int32_t target = addState(dfa, std::move(next));
+    dfa.transitions[static_cast<size_t>(state >> 1) + byte_classes[byte]] = target;
+    return target;
+}
+
+int Regex::findOnlyLeavingByte(DFA& dfa)
+{
+    const int32_t initial = getInitial(dfa);
+    int only = -1;
+    for (unsigned b = 0; b < 256; ++b)
+    {
+        if (step(dfa, initial, static_cast<uint8_t>(b)) == initial)
+            continue;
+        if (only != -1)
+            return -1;
+        only = static_cast<int>(b);
+    }
+    return only;
+}
+
+size_t Regex::findEarliestEnd(const string_view haystack, const size_t from, const size_t to)
+{
+    int32_t state = getInitial(forward);
+    const uint8_t* text = reinterpret_cast<const uint8_t*>(haystack.data());
+    for (size_t i = from; i < to; ++i)
+    {
+        if (state == forward.initial && first_byte != -1)
+        {
+            const void* found = memchr(text + i, first_byte, to - i);
+            if (found == nullptr)
+                return npos;
+            i = static_cast<size_t>(static_cast<const uint8_t*>(found) - text);
+        }
+        state = step(forward, state, text[i]);
+        if (state & 1)
+            return i + 1;
+    }
+    return npos;
+}
+
+void Regex::findStarts(const string_view haystack, const size_t first, const size_t line_end, vector<size_t>& starts)
+{
+    // the reverse program accepts wherever a match starts, given it ends somewhere before line_end.
+    // starts come out last to first
+    int32_t state = getInitial(reverse);
+    const uint8_t* text = reinterpret_cast<const uint8_t*>(haystack.data());
+    for (size_t i = line_end; i-- > first;)
+    {
+        if (state == reverse.initial && last_byte != -1)
+        {
+            i = last_byte_searcher.findPrevious(haystack, i + 1);
+            if (i == TextSearcher::npos || i < first)
+                return;
+        }
+        state = step(reverse, state, text[i]);
+        if (state & 1)
+            starts.push_back(i);
+    }
+}
+
+size_t Regex::findLongestEnd(const string_view haystack, const size_t start, const size_t line_end)
+{
+    const size_t flushes = forward_anchored.flushes;
+    int32_t state = getInitial(forward_anchored);
+    size_t end = start;
+    size_t i = start;
+    const uint8_t* text = reinterpret_cast<const uint8_t*>(haystack.data());
+    trail.clear();
+    for (; i < line_end; ++i)
+    {
+        state = step(forward_anchored, state, text[i]);
+        if (state == DEAD)
+            break;
+        // only states past the end of the match so far can lead nowhere
+        if (state & 1)
+        {
+            end = i + 1;
+            trail.clear();
+            continue;
+        }
+        // an earlier run has been here in this state, and found nothing more
+        if (!exhausted.empty() && exhausted.contains((static_cast<uint64_t>(i + 1) << 22) | static_cast<uint32_t>(state)))
+            break;
+        trail.push_back(state);
+    }
+    if (flushes != forward_anchored.flushes)
+    {
+        // the states on the trail, and the ones already noted, may not be the same ones any more
+        exhausted.clear();
+        return end;
+    }
+
+    for (size_t k = 0; k < trail.size(); ++k)
+        exhausted.insert((static_cast<uint64_t>(end + k + 1) << 22) | static_cast<uint32_t>(trail[k]));
+    return end;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "text_search.h"
+
+// regular expressions for the find popup, run as a lazily built DFA so a search is always linear
+// in the text, whatever the pattern. states are only built as the text reaches them, and the cache
+// of them is thrown away and started again when it fills up, so memory stays flat.
+// supported: literals, '.', [classes] with ranges and '^' negation, \d \w \s (and \D \W \S),
+// escapes, (groups), '|', and the * + ? {n} {n,} {n,m} repeats. matches never span a newline,
+// and never have zero length.
+// matches are leftmost-longest and don't overlap: the first to start is taken, as long as it can
+// be, and the next is looked for after it ends. each line with a match on it is found by one
+// forwards pass, then scanned back over once to find every start on it, and each match taken is
+// run forwards from its start until the pattern can't go any further. runs that look past the end
+// of their match (like "a.*z|a" over a line of a's) note each state they passed through there, as
+// none of them lead to another match. a later run reaching one at the same place stops, so each
+// line is stepped over at most once per state
+class Regex
+{
+public:
+    static constexpr size_t npos = std::string::npos;
+
+    struct Match
+    {
+        size_t start = npos;
+        size_t length = 0;
+    };
+
+private:
+    enum NodeType : uint8_t
+    {
+        NODE_SET,   // consumes one byte in sets[set]
+        NODE_SPLIT, // goes to both out and out1
+        NODE_EMPTY, // goes to out
+        NODE_MATCH
+    };
+
+    struct Node
+    {
+        NodeType type;
+        uint32_t set = 0;
+        uint32_t out = 0;
+        uint32_t out1 = 0;
+    };
+
+    struct Syntax
+    {
+        enum Kind : uint8_t
+        {
+            SET,
+            CONCAT,
+            ALTERNATE,
+            REPEAT
+        };
+        Kind kind;
+        uint32_t set = 0;
+        int min = 0;
+        int max = 0; // -1 for unbounded
+        std::vector<Syntax> children = { };
+    };
+
+    struct Fragment
+    {
+        uint32_t start;
+        std::vector<uint32_t> holes; // node * 2 + 1 for out1, node * 2 for out
+    };
+
+    // one of the three DFAs. states are referred to by where their row of transitions starts, times
+    // two, plus one if they accept. that keeps the scanning loops down to a load, a shift and an add
+    struct DFA
+    {
+        uint32_t start_node = 0;
+        bool unanchored = false;
+        std::vector<std::vector<uint32_t>> states;
+        std::vector<int32_t> transitions;
+        std::unordered_map<std::string, int32_t> lookup;
+        int32_t initial = UNKNOWN;
+        size_t flushes = 0;
+    };
+
+    static constexpr int32_t DEAD = -1;
+    static constexpr int32_t UNKNOWN = -2;
+    static constexpr size_t max_nodes = 20000;
+    static constexpr size_t max_states = 2048;
+
+    std::string error;
+    std::vector<std::bitset<256>> sets;
+    std::vector<Node> nodes;
+    std::array<uint8_t, 256> byte_classes{ };
+    size_t class_count = 1;
+    DFA forward;          // finds where the earliest match ends
+    DFA reverse;          // finds where matches start, scanning back from the end of a line
+    DFA forward_anchored; // finds how far a match runs from a known start
+    int first_byte = -1;  // the only byte a match can start with, if there is just one
+    int last_byte = -1;   // and the only one it can end with
+    TextSearcher last_byte_searcher{ "" };
+
+    std::vector<uint32_t> marks;
+    uint32_t mark_generation = 0;
+
+    // offset << 22 | forward_anchored state, for each state a run passed through after its match
+    // ended. only covers the line being worked through, and is emptied whenever that DFA's cache is
+    std::unordered_set<uint64_t> exhausted;
+    std::vector<int32_t> trail;
+
+public:
+    explicit Regex(std::string_view pattern);
+
+    bool isValid() const { return error.empty(); }
+    const std::string& getError() const { return error; }
+
+    // first match starting at or after from
+    Match findNext(std::string_view haystack, size_t from = 0);
+    // last match starting strictly before before
+    Match findPrevious(std::string_view haystack, size_t before = npos);
+    // every match starting in [from, to), taken one after another from from. from should start a
+    // line for them to agree with findNext
+    void findAll(std::string_view haystack, size_t from, size_t to, std::vector<Match>& matches);
+
+    size_t getCacheFlushes() const { return forward.flushes + reverse.flushes + forward_anchored.flushes; }
+
+private:
+    bool parseAlternation(std::string_view pattern, size_t& i, Syntax& result);
+    bool parseConcatenation(std::string_view pattern, size_t& i, Syntax& result);
+    bool parseRepeat(std::string_view pattern, size_t& i, Syntax& result);
+    bool parseAtom(std::string_view pattern, size_t& i, Syntax& result);
+    bool parseClass(std::string_view pattern, size_t& i, std::bitset<256>& set);
+    bool parseEscape(std::string_view pattern, size_t& i, std::bitset<256>& set);
+    uint32_t addSet(std::bitset<256> set);
+
+    uint32_t addNode(NodeType type, uint32_t set = 0);
+    void patch(const std::vector<uint32_t>& holes, uint32_t target);
+    Fragment compile(const Syntax& syntax, bool reversed);
+    uint32_t compileProgram(const Syntax& syntax, bool reversed);
+    void buildByteClasses();
+
+    void addClosure(std::vector<uint32_t>& set, uint32_t node);
+    int32_t addState(DFA& dfa, std::vector<uint32_t> nfa_states);
+    int32_t getInitial(DFA& dfa);
+    int32_t computeTransition(DFA& dfa, int32_t state, uint8_t byte);
+    int findOnlyLeavingByte(DFA& dfa);
+    int32_t step(DFA& dfa, int32_t state, uint8_t byte)
+    {
+        const int32_t next = dfa.transitions[static_cast<size_t>(state >> 1) + byte_classes[byte]];
+        return (next != UNKNOWN) ? next : computeTransition(dfa, state, byte);
+    }
+    static bool isAccepting(int32_t state) { return state >= 0 && (state & 1); }
+
+    size_t findEarliestEnd(std::string_view haystack, size_t from, size_t to);
+    void findStarts(std::string_view haystack, size_t first, size_t line_end, std::vector<size_t>& starts);
+    size_t findLongestEnd(std::string_view haystack, size_t start, size_t line_end);
+};
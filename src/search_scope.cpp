@@ -0,0 +1,89 @@
+#include "search_scope.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void SearchScope::set(vector<Range> new_ranges)
+{
+    active = true;
+    ranges = std::move(new_ranges);
+}
+
+void SearchScope::clear()
+{
+    active = false;
+    ranges.clear();
+}
+
+void SearchScope::applyEdit(const size_t offset, const size_t removed, const size_t inserted)
+{
+    for (auto& [start, end] : ranges)
+    {
+        if (start >= offset + removed)
+            start = start + inserted - removed;
+        else if (start > offset)
+            start = offset;
+        if (end >= offset + removed)
+            end = end + inserted - removed;
+        else if (end > offset)
+            end = offset;
+    }
+    erase_if(ranges, [](const Range& range) { return range.first >= range.second; });
+}
+
+void SearchScope::applyEdits(const vector<TextEdit>& edits)
+{
+    // put every edit in terms of the text from before any of them
+    vector<TextEdit> original;
+    original.reserve(edits.size());
+    size_t shift = 0;
+    size_t next_allowed = 0;
+    for (const TextEdit& edit : edits)
+    {
+        if (edit.offset < next_allowed)
+        {
+            for (const TextEdit& each : edits)
+                applyEdit(each.offset, each.removed, each.inserted);
+            return;
+        }
+        original.push_back(TextEdit{ edit.version, edit.offset - shift, edit.removed, edit.inserted });
+        shift = shift + edit.inserted - edit.removed;
+        next_allowed = edit.offset + edit.inserted;
+    }
+
+    // positions only go forwards, so the edits before each one are only added up once
+    size_t next = 0;
+    shift = 0;
+    auto movePosition = [&](size_t position)
+    {
+        for (; next < original.size() && original[next].offset + original[next].removed <= position; ++next)
+            shift = shift + original[next].inserted - original[next].removed;
+        // inside an edit it's cut to where that starts. pure inserts right where it ends up still
+        // push it along, as they would one at a time
+        size_t moved = position + shift;
+        if (next < original.size() && original[next].offset < position)
+            moved = original[next].offset + shift;
+        for (size_t later = next, later_shift = shift; later < original.size(); ++later)
+        {
+            const TextEdit& edit = original[later];
+            if (edit.offset + later_shift != moved)
+                break;
+            if (edit.removed == 0)
+                moved += edit.inserted;
+            later_shift = later_shift + edit.inserted - edit.removed;
+        }
+        return moved;
+    };
+    for (auto& [start, end] : ranges)
+    {
+        start = movePosition(start);
+        end = movePosition(end);
+    }
+    erase_if(ranges, [](const Range& range) { return range.first >= range.second; });
+}
+
+vector<SearchScope::Range>::const_iterator SearchScope::findFirst(const size_t offset) const
+{
+    return lower_bound(ranges.begin(), ranges.end(), offset, [](const Range& range, size_t value) { return range.second <= value; });
+}
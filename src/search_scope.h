@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "edit_log.h"
+
+// ranges of the buffer a search is limited to, sorted and disjoint. they follow edits until the
+// next set comes in, with text typed inside or at the end of a range joining it
+class SearchScope
+{
+public:
+    using Range = std::pair<size_t, size_t>;
+
+private:
+    bool active = false;
+    std::vector<Range> ranges;
+
+public:
+    void set(std::vector<Range> new_ranges);
+    void clear();
+    void applyEdit(size_t offset, size_t removed, size_t inserted);
+    // the same for a run of edits, which are walked along with the ranges in one pass if each
+    // starts after the text the one before inserted, as a replace all makes them
+    void applyEdits(const std::vector<TextEdit>& edits);
+
+    bool isActive() const { return active; }
+    const std::vector<Range>& getRanges() const { return ranges; }
+    // the first range ending after offset
+    std::vector<Range>::const_iterator findFirst(size_t offset) const;
+};
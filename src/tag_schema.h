@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+enum TagIDRole : uint8_t
+{
+    ID_NONE,
+    ID_DEFINES,
+    ID_REFERENCES
+};
+
+struct TagSchema
+{
+    std::string_view name;
+    std::array<std::string_view, 2> required;
+    std::array<std::string_view, 2> optional;
+    TagIDRole id_role;
+    std::string_view target; // for ID_REFERENCES tags, the tag type being referenced
+};
+
+// every tag type the parser understands. adding a tag means adding a line here
+static constexpr TagSchema tag_schemas[] =
+{
+    { "title",   { },               { },                       ID_NONE },
+    { "config",  { },               { "columns", "citations" }, ID_NONE },
+    { "bib",     { },               { },                       ID_NONE },
+    { "fig",     { "id", "image" }, { "caption" },             ID_DEFINES },
+    { "figref",  { "id" },          { },                       ID_REFERENCES, "fig" },
+    { "section", { "id" },          { "title" },               ID_DEFINES },
+    { "sectref", { "id" },          { },                       ID_REFERENCES, "section" },
+    { "cite",    { },               { "key" },                 ID_NONE },
+    { "math",    { },               { },                       ID_NONE },
+    { "code",    { },               { },                       ID_NONE },
+};
+
+static constexpr size_t tag_schema_count = std::size(tag_schemas);
+
+template <size_t... I>
+constexpr size_t findTagSchema(std::string_view type, std::index_sequence<I...>)
+{
+    size_t index = tag_schema_count;
+    (void)((tag_schemas[I].name == type ? (index = I, true) : false) || ...);
+    return index;
+}
+
+// returns tag_schema_count if the type is not recognised
+constexpr size_t findTagSchema(std::string_view type)
+{
+    return findTagSchema(type, std::make_index_sequence<tag_schema_count>{ });
+}
+
+// compile-time only lookup, for use as a case label. misspelled names fail to compile
+consteval size_t tagSchemaIndex(std::string_view type)
+{
+    const size_t index = findTagSchema(type);
+    if (index == tag_schema_count)
+        throw "unknown tag type";
+    return index;
+}
+
+constexpr bool tagSchemaRequires(const TagSchema& schema, std::string_view param)
+{
+    for (const std::string_view required : schema.required)
+    {
+        if (required == param)
+            return true;
+    }
+    return false;
+}
+
+constexpr bool validateTagSchemas()
+{
+    for (size_t i = 0; i < tag_schema_count; ++i)
+    {
+        if (tag_schemas[i].name.empty())
+            return false;
+        for (size_t j = i + 1; j < tag_schema_count; ++j)
+        {
+            if (tag_schemas[i].name == tag_schemas[j].name)
+                return false;
+        }
+        if (tag_schemas[i].id_role != ID_NONE && !tagSchemaRequires(tag_schemas[i], "id"))
+            return false;
+        if (tag_schemas[i].id_role == ID_REFERENCES)
+        {
+            const size_t target = findTagSchema(tag_schemas[i].target);
+            if (target == tag_schema_count || tag_schemas[target].id_role != ID_DEFINES)
+                return false;
+        }
+    }
+    return true;
+}
+
+static_assert(validateTagSchemas(), "tag schema table has duplicate names, id tags without an 'id' param, or references to tags which don't define ids");
@@ -0,0 +1,222 @@
+#include "text_fold.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// base letters for U+00C0 to U+017F. '*' letters only change case, and the digits expand to
+// ae, ss, ij and oe
+static constexpr string_view accent_bases =
+    "aaaaaa1ceeeeiiiidnooooo*ouuuuy*2"
+    "aaaaaa1ceeeeiiiidnooooo*ouuuuy*y"
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii33jjkkkllllllllllnnnnnnnnnoooooo44rrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+static_assert(accent_bases.size() == 0x180 - 0xC0);
+
+static uint32_t foldCase(const uint32_t code_point)
+{
+    if (code_point >= 0xC0 && code_point <= 0xDE && code_point != 0xD7)
+        return code_point + 0x20;
+    if (code_point == 0x130)
+        return 'i';
+    if (code_point == 0x178)
+        return 0xFF;
+    const bool even = (code_point % 2) == 0;
+    if ((code_point >= 0x100 && code_point <= 0x137 && even) || (code_point >= 0x139 && code_point <= 0x148 && !even)
+        || (code_point >= 0x14A && code_point <= 0x177 && even) || (code_point >= 0x179 && code_point <= 0x17E && !even))
+        return code_point + 1;
+    return code_point;
+}
+
+// writes the folded form of a U+00C0 to U+017F letter, returning how many bytes it took
+static size_t foldLetter(const uint32_t code_point, const FoldMode mode, char* out)
+{
+    if (mode == FOLD_CASE_AND_ACCENTS)
+    {
+        static constexpr string_view expansions[4] = { "ae", "ss", "ij", "oe" };
+        const char base = accent_bases[code_point - 0xC0];
+        if (base >= '1' && base <= '4')
+        {
+            const string_view expansion = expansions[base - '1'];
+            copy(expansion.begin(), expansion.end(), out);
+            return expansion.size();
+        }
+        if (base != '*')
+        {
+            out[0] = base;
+            return 1;
+        }
+    }
+    const uint32_t folded = foldCase(code_point);
+    if (folded < 0x80)
+    {
+        out[0] = static_cast<char>(folded);
+        return 1;
+    }
+    out[0] = static_cast<char>(0xC0 | (folded >> 6));
+    out[1] = static_cast<char>(0x80 | (folded & 0x3F));
+    return 2;
+}
+
+size_t FoldedText::Chunk::toOriginal(const size_t folded, const bool round_up, size_t& next_unit) const
+{
+    while (next_unit < units.size() && units[next_unit].folded_start <= folded)
+        ++next_unit;
+    if (next_unit == 0)
+        return folded;
+    const Unit& unit = units[next_unit - 1];
+    if (folded < unit.folded_start + unit.folded_size)
+        return (round_up && folded > unit.folded_start) ? unit.original_start + unit.original_size : unit.original_start;
+    return unit.original_start + unit.original_size + (folded - unit.folded_start - unit.folded_size);
+}
+
+shared_ptr<const FoldedText::Chunk> FoldedText::fold(const string_view text, const FoldMode fold_mode)
+{
+    auto chunk = make_shared<Chunk>();
+    string& out = chunk->text;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size();)
+    {
+        const uint8_t c = static_cast<uint8_t>(text[i]);
+        if (c < 0x80)
+        {
+            out.push_back((c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : static_cast<char>(c));
+            ++i;
+            continue;
+        }
+        // everything folded is a two byte sequence led by C3, C4 or C5. anything else is copied as is
+        if (c < 0xC3 || c > 0xC5 || i + 1 >= text.size() || (static_cast<uint8_t>(text[i + 1]) & 0xC0) != 0x80)
+        {
+            out.push_back(static_cast<char>(c));
+            ++i;
+            continue;
+        }
+        const uint32_t code_point = ((c & 0x1Fu) << 6) | (static_cast<uint8_t>(text[i + 1]) & 0x3Fu);
+        char folded[2];
+        const size_t folded_size = foldLetter(code_point, fold_mode, folded);
+        // ascii results get a unit even when they're the same size, since a match can start
+        // between the two letters of an expansion
+        if (folded_size != 2 || static_cast<uint8_t>(folded[0]) < 0x80)
+            chunk->units.push_back(Unit{ static_cast<uint32_t>(out.size()), static_cast<uint32_t>(i), static_cast<uint8_t>(folded_size), 2 });
+        out.append(folded, folded_size);
+        i += 2;
+    }
+    return chunk;
+}
+
+void FoldedText::findAll(const Chunk& chunk, const size_t chunk_start, const TextSearcher& searcher, const size_t needle_size, vector<size_t>& starts, vector<uint32_t>& lengths)
+{
+    // a folded match can begin partway into what one letter folded to (the second 's' of a 'ß'),
+    // which makes it the same match as the one before
+    const size_t first = starts.size();
+    size_t start_unit = 0;
+    size_t end_unit = 0;
+    for (size_t offset = searcher.findNext(chunk.text); offset != TextSearcher::npos; offset = searcher.findNext(chunk.text, offset + 1))
+    {
+        const size_t start = chunk_start + chunk.toOriginal(offset, false, start_unit);
+        if (starts.size() > first && starts.back() == start)
+            continue;
+        starts.push_back(start);
+        lengths.push_back(static_cast<uint32_t>(chunk_start + chunk.toOriginal(offset + needle_size, true, end_unit) - start));
+    }
+}
+
+bool FoldedText::findAll(const Snapshot& snapshot, const TextSearcher& searcher, const size_t needle_size, vector<size_t>& starts, vector<uint32_t>& lengths, vector<shared_ptr<const Chunk>>& folded, const atomic<bool>* const cancelled)
+{
+    folded.assign(snapshot.spans.size(), nullptr);
+    for (size_t span = 0; span < snapshot.spans.size(); ++span)
+    {
+        if (cancelled != nullptr && cancelled->load())
+            return false;
+        shared_ptr<const Chunk> chunk = snapshot.spans[span].folded;
+        if (!chunk)
+            chunk = folded[span] = fold(snapshot.sources[span], snapshot.mode);
+        findAll(*chunk, snapshot.spans[span].start, searcher, needle_size, starts, lengths);
+    }
+    return true;
+}
+
+void FoldedText::prepare(const string_view buffer, const FoldMode fold_mode)
+{
+    if (fold_mode != mode || buffer.size() != text_size || (spans.empty() && !buffer.empty()))
+    {
+        mode = fold_mode;
+        text_size = buffer.size();
+        spans.clear();
+        split(buffer, 0, buffer.size(), spans);
+        return;
+    }
+    // edits merge chunks together, so ones which have grown too big are broken up again
+    if (none_of(spans.begin(), spans.end(), [](const Span& span) { return !span.folded && span.size > chunk_size * 4; }))
+        return;
+    vector<Span> result;
+    for (Span& span : spans)
+    {
+        if (!span.folded && span.size > chunk_size * 4)
+            split(buffer, span.start, span.start + span.size, result);
+        else
+            result.push_back(std::move(span));
+    }
+    spans = std::move(result);
+}
+
+void FoldedText::clear()
+{
+    text_size = 0;
+    spans.clear();
+}
+
+void FoldedText::applyEdit(const size_t offset, const size_t removed, const size_t inserted)
+{
+    text_size = text_size + inserted - removed;
+    if (spans.empty())
+        return;
+    auto containing = [this](size_t position)
+    {
+        const auto after = upper_bound(spans.begin(), spans.end(), position, [](size_t p, const Span& span) { return p < span.start; });
+        return static_cast<size_t>(after - spans.begin()) - 1;
+    };
+    const size_t first = containing(offset);
+    const size_t last = containing(offset + removed);
+    spans[first].size = spans[last].start + spans[last].size + inserted - removed - spans[first].start;
+    spans[first].folded.reset();
+    spans.erase(spans.begin() + static_cast<ptrdiff_t>(first) + 1, spans.begin() + static_cast<ptrdiff_t>(last) + 1);
+    for (size_t i = first + 1; i < spans.size(); ++i)
+        spans[i].start = spans[i].start + inserted - removed;
+}
+
+FoldedText::Snapshot FoldedText::takeSnapshot(const string_view buffer) const
+{
+    Snapshot snapshot{ mode, spans, vector<string>(spans.size()) };
+    for (size_t span = 0; span < spans.size(); ++span)
+    {
+        if (!spans[span].folded)
+            snapshot.sources[span] = buffer.substr(spans[span].start, spans[span].size);
+    }
+    return snapshot;
+}
+
+void FoldedText::install(vector<shared_ptr<const Chunk>> folded)
+{
+    for (size_t span = 0; span < folded.size() && span < spans.size(); ++span)
+    {
+        if (folded[span] && !spans[span].folded)
+            spans[span].folded = std::move(folded[span]);
+    }
+}
+
+void FoldedText::split(const string_view buffer, const size_t from, const size_t to, vector<Span>& result) const
+{
+    // chunks end just after a newline, so every chunk starts a line
+    for (size_t start = from; start < to;)
+    {
+        size_t end = to;
+        if (start + chunk_size < to)
+        {
+            const size_t newline = buffer.find('\n', start + chunk_size);
+            if (newline != string_view::npos && newline + 1 < to)
+                end = newline + 1;
+        }
+        result.push_back(Span{ start, end - start, nullptr });
+        start = end;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "text_search.h"
+
+enum FoldMode : uint8_t
+{
+    FOLD_CASE,            // A-Z, and the latin-1 and latin extended-A letters, to lower case
+    FOLD_CASE_AND_ACCENTS // and those letters down to their plain ascii base, so "É" finds "e"
+};
+
+// a case (and optionally accent) folded copy of a buffer, so folded searches can run over it at
+// full literal speed instead of folding every byte for every query. the buffer is split into
+// chunks of whole lines, which are folded the first time something asks for them and kept until an
+// edit touches them. no match crosses a newline, so each chunk can be searched on its own.
+// folding can change how long a character is, so each chunk also lists where that happens, which
+// is enough to map any folded offset back into the buffer
+class FoldedText
+{
+public:
+    // a letter which folded to a different length, or to ascii, and so needs mapping back by hand
+    struct Unit
+    {
+        uint32_t folded_start;
+        uint32_t original_start;
+        uint8_t folded_size;
+        uint8_t original_size;
+    };
+
+    struct Chunk
+    {
+        std::string text;
+        std::vector<Unit> units;
+
+        // offsets inside a unit go to its start, or its end when rounding up (for match ends).
+        // next_unit is where the units are read from, and only ever moves forwards, so offsets
+        // mapped with the same one can't go backwards
+        size_t toOriginal(size_t folded, bool round_up, size_t& next_unit) const;
+    };
+
+    struct Span
+    {
+        size_t start;
+        size_t size;
+        std::shared_ptr<const Chunk> folded; // empty until something needs it
+    };
+
+    // the spans as they were, with copies of the text not yet folded, for searching off the thread
+    // the buffer belongs to
+    struct Snapshot
+    {
+        FoldMode mode;
+        std::vector<Span> spans;
+        std::vector<std::string> sources; // by span, empty where it's already folded
+    };
+
+private:
+    static constexpr size_t chunk_size = 64 * 1024;
+
+    FoldMode mode = FOLD_CASE;
+    size_t text_size = 0;
+    std::vector<Span> spans;
+
+public:
+    static std::shared_ptr<const Chunk> fold(std::string_view text, FoldMode fold_mode);
+    // appends where the folded needle occurs in the chunk, as ranges of the original text
+    static void findAll(const Chunk& chunk, size_t chunk_start, const TextSearcher& searcher, size_t needle_size, std::vector<size_t>& starts, std::vector<uint32_t>& lengths);
+    // the same over every span of a snapshot, folding whichever it has to. those come back in
+    // folded, by span, to be installed. false if cancelled partway
+    static bool findAll(const Snapshot& snapshot, const TextSearcher& searcher, size_t needle_size, std::vector<size_t>& starts, std::vector<uint32_t>& lengths, std::vector<std::shared_ptr<const Chunk>>& folded, const std::atomic<bool>* cancelled = nullptr);
+
+    // re-chunks the buffer if it isn't the one being tracked, or the mode has changed
+    void prepare(std::string_view buffer, FoldMode fold_mode);
+    void clear();
+    // chunks touched by the edit are merged and forgotten, and everything after them moves along
+    void applyEdit(size_t offset, size_t removed, size_t inserted);
+
+    FoldMode getMode() const { return mode; }
+    Snapshot takeSnapshot(std::string_view buffer) const;
+    // hands back chunks folded for a snapshot, which must have been taken since the last edit
+    void install(std::vector<std::shared_ptr<const Chunk>> folded);
+
+private:
+    void split(std::string_view buffer, size_t from, size_t to, std::vector<Span>& result) const;
+};
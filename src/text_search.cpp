@@ -0,0 +1,146 @@
+#include "text_search.h"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXT_SEARCH_SSE2
+#endif
+
+using namespace std;
+
+TextSearcher::TextSearcher(string_view pattern) :
+    needle(pattern)
+{
+    // forward skips by the last byte of the window, backward by the first
+    const size_t m = needle.size();
+    forward_skip.fill(max<size_t>(m, 1));
+    backward_skip.fill(max<size_t>(m, 1));
+    for (size_t i = 0; i + 1 < m; ++i)
+        forward_skip[static_cast<uint8_t>(needle[i])] = m - 1 - i;
+    for (size_t i = m; i-- > 1;)
+        backward_skip[static_cast<uint8_t>(needle[i])] = i;
+}
+
+size_t TextSearcher::findNext(string_view haystack, size_t from) const
+{
+    if (needle.empty())
+        return (from <= haystack.size()) ? from : npos;
+    if (needle.size() > haystack.size() || from > haystack.size() - needle.size())
+        return npos;
+    return scanForward(haystack, from, haystack.size() - needle.size());
+}
+
+size_t TextSearcher::findPrevious(string_view haystack, size_t before) const
+{
+    if (needle.empty())
+        return (before > 0) ? min(before - 1, haystack.size()) : npos;
+    if (needle.size() > haystack.size() || before == 0)
+        return npos;
+    return scanBackward(haystack, 0, min(before - 1, haystack.size() - needle.size()));
+}
+
+// both scans look at match starts in [first, last], inclusive
+size_t TextSearcher::scanForward(string_view haystack, size_t first, size_t last) const
+{
+    const size_t m = needle.size();
+    const char* h = haystack.data();
+#if defined(TEXT_SEARCH_SSE2)
+    if (m > 1)
+    {
+        const __m128i first_byte = _mm_set1_epi8(needle[0]);
+        const __m128i last_byte = _mm_set1_epi8(needle[m - 1]);
+        // two blocks at a time, since most of them have no candidates at all
+        for (; first + 31 <= last; first += 32)
+        {
+            const __m128i* lo = reinterpret_cast<const __m128i*>(h + first);
+            const __m128i* hi = reinterpret_cast<const __m128i*>(h + first + m - 1);
+            const __m128i match_low = _mm_and_si128(_mm_cmpeq_epi8(first_byte, _mm_loadu_si128(lo)), _mm_cmpeq_epi8(last_byte, _mm_loadu_si128(hi)));
+            const __m128i match_high = _mm_and_si128(_mm_cmpeq_epi8(first_byte, _mm_loadu_si128(lo + 1)), _mm_cmpeq_epi8(last_byte, _mm_loadu_si128(hi + 1)));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(match_low)) | (static_cast<uint32_t>(_mm_movemask_epi8(match_high)) << 16);
+            while (mask != 0)
+            {
+                const size_t candidate = first + countr_zero(mask);
+                if (memcmp(h + candidate + 1, needle.data() + 1, m - 2) == 0)
+                    return candidate;
+                mask &= mask - 1;
+            }
+        }
+        if (first > last)
+            return npos;
+    }
+#endif
+    if (m == 1)
+    {
+        const void* found = memchr(h + first, needle[0], last - first + 1);
+        return (found == nullptr) ? npos : static_cast<size_t>(static_cast<const char*>(found) - h);
+    }
+    return horspoolForward(haystack, first, last);
+}
+
+size_t TextSearcher::scanBackward(string_view haystack, size_t first, size_t last) const
+{
+    const size_t m = needle.size();
+    const char* h = haystack.data();
+#if defined(TEXT_SEARCH_SSE2)
+    {
+        // blocks of 32 starts ending at last, working down. the highest set bit is the latest match
+        const __m128i first_byte = _mm_set1_epi8(needle[0]);
+        const __m128i last_byte = _mm_set1_epi8(needle[m - 1]);
+        while (last >= first + 31)
+        {
+            const size_t block = last - 31;
+            const __m128i* lo = reinterpret_cast<const __m128i*>(h + block);
+            const __m128i* hi = reinterpret_cast<const __m128i*>(h + block + m - 1);
+            const __m128i match_low = _mm_and_si128(_mm_cmpeq_epi8(first_byte, _mm_loadu_si128(lo)), _mm_cmpeq_epi8(last_byte, _mm_loadu_si128(hi)));
+            const __m128i match_high = _mm_and_si128(_mm_cmpeq_epi8(first_byte, _mm_loadu_si128(lo + 1)), _mm_cmpeq_epi8(last_byte, _mm_loadu_si128(hi + 1)));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(match_low)) | (static_cast<uint32_t>(_mm_movemask_epi8(match_high)) << 16);
+            while (mask != 0)
+            {
+                const int bit = 31 - countl_zero(mask);
+                const size_t candidate = block + bit;
+                if (m <= 2 || memcmp(h + candidate + 1, needle.data() + 1, m - 2) == 0)
+                    return candidate;
+                mask &= ~(1u << bit);
+            }
+            if (block == first)
+                return npos;
+            last = block - 1;
+        }
+    }
+#endif
+    return horspoolBackward(haystack, first, last);
+}
+
+size_t TextSearcher::horspoolForward(string_view haystack, size_t first, size_t last) const
+{
+    const size_t m = needle.size();
+    const char* h = haystack.data();
+    const char final_byte = needle[m - 1];
+    while (first <= last)
+    {
+        const char c = h[first + m - 1];
+        if (c == final_byte && memcmp(h + first, needle.data(), m - 1) == 0)
+            return first;
+        first += forward_skip[static_cast<uint8_t>(c)];
+    }
+    return npos;
+}
+
+size_t TextSearcher::horspoolBackward(string_view haystack, size_t first, size_t last) const
+{
+    const size_t m = needle.size();
+    const char* h = haystack.data();
+    const char first_byte = needle[0];
+    while (true)
+    {
+        const char c = h[last];
+        if (c == first_byte && memcmp(h + last + 1, needle.data() + 1, m - 1) == 0)
+            return last;
+        const size_t skip = backward_skip[static_cast<uint8_t>(c)];
+        if (last < first + skip)
+            return npos;
+        last -= skip;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// exact substring search in either direction. where SSE2 is available, candidate positions are
+// found 32 at a time by comparing the needle's first and last bytes against the haystack, and
+// only those get a full comparison. otherwise (and for the ragged ends) it falls back to
+// Boyer-Moore-Horspool, which skips by the byte at the far end of the window
+class TextSearcher
+{
+private:
+    std::string needle;
+    std::array<size_t, 256> forward_skip;
+    std::array<size_t, 256> backward_skip;
+
+public:
+    static constexpr size_t npos = std::string::npos;
+
+    explicit TextSearcher(std::string_view pattern);
+
+    // first match starting at or after from
+    size_t findNext(std::string_view haystack, size_t from = 0) const;
+    // last match starting strictly before before
+    size_t findPrevious(std::string_view haystack, size_t before = npos) const;
+    const std::string& getNeedle() const { return needle; }
+
+private:
+    size_t scanForward(std::string_view haystack, size_t first, size_t last) const;
+    size_t scanBackward(std::string_view haystack, size_t first, size_t last) const;
+    size_t horspoolForward(std::string_view haystack, size_t first, size_t last) const;
+    size_t horspoolBackward(std::string_view haystack, size_t first, size_t last) const;
+};
@@ -0,0 +1,52 @@
+#include "text_stats.h"
+
+using namespace std;
+
+void TextStats::recount(const string_view buffer)
+{
+    words = 0;
+    characters = 0;
+    newlines = 0;
+    count(' ', buffer, ' ', false);
+}
+
+void TextStats::applyEdit(const string_view buffer, const size_t offset, const string_view removed_text, const size_t inserted)
+{
+    // the bytes either side of the edit are the same before and after it
+    const char before = (offset > 0) ? buffer[offset - 1] : ' ';
+    const char after = (offset + inserted < buffer.size()) ? buffer[offset + inserted] : ' ';
+    count(before, removed_text, after, true);
+    count(before, buffer.substr(offset, inserted), after, false);
+}
+
+void TextStats::count(char before, const string_view text, const char after, const bool subtract)
+{
+    size_t text_words = 0;
+    size_t text_characters = 0;
+    size_t text_newlines = 0;
+    for (const char c : text)
+    {
+        if (isWordByte(c) && !isWordByte(before))
+            ++text_words;
+        if (isCharacterStart(c))
+            ++text_characters;
+        if (c == '\n')
+            ++text_newlines;
+        before = c;
+    }
+    if (isWordByte(after) && !isWordByte(before))
+        ++text_words;
+
+    if (subtract)
+    {
+        words -= text_words;
+        characters -= text_characters;
+        newlines -= text_newlines;
+    }
+    else
+    {
+        words += text_words;
+        characters += text_characters;
+        newlines += text_newlines;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// word, character and line totals for a buffer, kept up to date edit by edit. a word is a run of
+// ascii letters and digits, so it's counted where it starts, which only depends on a byte and
+// the one before it. an edit can therefore only change the starts inside it and the one just
+// after it, and those are all that get looked at
+class TextStats
+{
+private:
+    size_t words = 0;
+    size_t characters = 0; // utf-8 code points
+    size_t newlines = 0;
+
+public:
+    void recount(std::string_view buffer);
+    // buffer is after the edit, removed_text is what used to be at offset
+    void applyEdit(std::string_view buffer, size_t offset, std::string_view removed_text, size_t inserted);
+
+    size_t getWords() const { return words; }
+    size_t getCharacters() const { return characters; }
+    size_t getLines() const { return newlines + 1; }
+
+private:
+    static bool isWordByte(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'); }
+    static bool isCharacterStart(char c) { return (static_cast<unsigned char>(c) & 0xC0) != 0x80; }
+    // adds (or takes away) what text contributes, where before is the byte ahead of it. word
+    // starts are counted in text and also at after, the byte following it
+    void count(char before, std::string_view text, char after, bool subtract);
+};
@@ -0,0 +1,138 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t thread_count, size_t urgent_threads)
+{
+    for (size_t i = 1; i < thread_count; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    for (size_t i = 0; i < urgent_threads; ++i)
+        workers.emplace_back(&ThreadPool::urgentWorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    // anything still queued is dropped rather than run, since nobody is left to want the results.
+    // the tasks are destroyed outside the lock, in case they own something that submits more
+    queue<function<void()>> dropped;
+    queue<function<void()>> dropped_urgent;
+    {
+        lock_guard lock(tasks_mutex);
+        stopping = true;
+        swap(dropped, tasks);
+        swap(dropped_urgent, urgent_tasks);
+    }
+    tasks_available.notify_all();
+    urgent_available.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(function<void()> task, const TaskPriority priority)
+{
+    {
+        lock_guard lock(tasks_mutex);
+        if (stopping)
+            return;
+        if (priority == PRIORITY_URGENT)
+            urgent_tasks.push(std::move(task));
+        else
+            tasks.push(std::move(task));
+    }
+    // an urgent task goes to whichever kind of worker is free first
+    tasks_available.notify_one();
+    if (priority == PRIORITY_URGENT)
+        urgent_available.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body)
+{
+    if (count == 0)
+        return;
+    if (workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            body(i);
+        return;
+    }
+
+    // indices are claimed from a shared counter, so it doesn't matter how many helpers actually
+    // get scheduled. the caller works too, which means this is safe to call from inside a task
+    struct Batch
+    {
+        atomic<size_t> next = 0;
+        atomic<size_t> finished = 0;
+        mutex done_mutex;
+        condition_variable done;
+    };
+    auto batch = make_shared<Batch>();
+    auto run = [batch, &body, count]()
+    {
+        size_t index;
+        while ((index = batch->next.fetch_add(1)) < count)
+        {
+            body(index);
+            if (batch->finished.fetch_add(1) + 1 == count)
+            {
+                lock_guard lock(batch->done_mutex);
+                batch->done.notify_all();
+            }
+        }
+    };
+
+    // the caller is blocked until the batch is done, so its helpers don't wait behind background work
+    const size_t helpers = min(workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; ++i)
+        submit(run, PRIORITY_URGENT);
+    run();
+
+    unique_lock lock(batch->done_mutex);
+    batch->done.wait(lock, [&]() { return batch->finished.load() == count; });
+}
+
+ThreadPool& ThreadPool::getShared()
+{
+    // background work is submitted here too, so there has to be at least one worker to run it. one
+    // more is kept for parsing, so a long search can't hold up the next document generation
+    static ThreadPool pool(max(thread::hardware_concurrency(), 2u), 1);
+    return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        function<void()> task;
+        {
+            unique_lock lock(tasks_mutex);
+            tasks_available.wait(lock, [this]() { return stopping || !urgent_tasks.empty() || !tasks.empty(); });
+            if (stopping)
+                return;
+            queue<function<void()>>& source = urgent_tasks.empty() ? tasks : urgent_tasks;
+            task = std::move(source.front());
+            source.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::urgentWorkerLoop()
+{
+    while (true)
+    {
+        function<void()> task;
+        {
+            unique_lock lock(tasks_mutex);
+            urgent_available.wait(lock, [this]() { return stopping || !urgent_tasks.empty(); });
+            if (stopping)
+                return;
+            task = std::move(urgent_tasks.front());
+            urgent_tasks.pop();
+        }
+        task();
+    }
+}
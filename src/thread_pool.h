@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// urgent tasks are taken before any background ones, for work the user is waiting on
+enum TaskPriority
+{
+    PRIORITY_BACKGROUND,
+    PRIORITY_URGENT
+};
+
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::queue<std::function<void()>> urgent_tasks;
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_available;
+    std::condition_variable urgent_available;
+    bool stopping = false;
+
+public:
+    // thread_count includes the calling thread, which always helps out in parallelFor. the
+    // urgent_threads are on top of those, and never pick up background tasks
+    explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency(), size_t urgent_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t getThreadCount() const { return workers.size() + 1; }
+
+    void submit(std::function<void()> task, TaskPriority priority = PRIORITY_BACKGROUND);
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    static ThreadPool& getShared();
+
+private:
+    void workerLoop();
+    void urgentWorkerLoop();
+};
@@ -0,0 +1,110 @@
+#include "trigram_index.h"
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+unique_ptr<TrigramIndex> TrigramIndex::build(const string_view buffer, const size_t memory_budget, const atomic<bool>* const cancelled)
+{
+    const size_t block_count = (buffer.size() + block_size - 1) / block_size;
+    auto forEachBlock = [&](auto&& visit)
+    {
+        // a block only records each bucket once, whichever trigram of its gets there first
+        vector<uint32_t> last_block(bucket_count, UINT32_MAX);
+        for (size_t block = 0; block < block_count; ++block)
+        {
+            if (cancelled != nullptr && (block % 256) == 0 && cancelled->load())
+                return false;
+            const size_t from = block * block_size;
+            // every trigram starting in the first block_overlap bytes of the next block belongs here
+            // too, which takes two bytes beyond them
+            const size_t to = min(from + block_size + block_overlap + 2, buffer.size());
+            for (size_t i = from; i + 3 <= to; ++i)
+            {
+                const size_t bucket = getBucket(buffer.data() + i);
+                if (last_block[bucket] == block)
+                    continue;
+                last_block[bucket] = static_cast<uint32_t>(block);
+                visit(bucket, static_cast<uint32_t>(block));
+            }
+        }
+        return true;
+    };
+
+    // counted first, so an index over budget is given up on before anything big is allocated
+    vector<uint32_t> counts(bucket_count, 0);
+    size_t total = 0;
+    if (!forEachBlock([&](size_t bucket, uint32_t) { ++counts[bucket]; ++total; }))
+        return nullptr;
+    if ((total + bucket_count + 1) * sizeof(uint32_t) > memory_budget)
+        return nullptr;
+
+    auto index = make_unique<TrigramIndex>();
+    index->text_size = buffer.size();
+    index->bucket_offsets.resize(bucket_count + 1);
+    uint32_t running = 0;
+    for (size_t bucket = 0; bucket < bucket_count; ++bucket)
+    {
+        index->bucket_offsets[bucket] = running;
+        running += counts[bucket];
+    }
+    index->bucket_offsets[bucket_count] = running;
+    index->postings.resize(total);
+    // blocks are visited in order, so every bucket's list comes out sorted
+    vector<uint32_t>& next = counts;
+    copy(index->bucket_offsets.begin(), index->bucket_offsets.end() - 1, next.begin());
+    if (!forEachBlock([&](size_t bucket, uint32_t block) { index->postings[next[bucket]++] = block; }))
+        return nullptr;
+    return index;
+}
+
+shared_ptr<TrigramIndex::Build> TrigramIndex::buildInBackground(ThreadPool& pool, string snapshot, const uint64_t version, const size_t memory_budget)
+{
+    auto pending = make_shared<Build>();
+    pending->version = version;
+    BackgroundJob::submit(pool, pending, [task_snapshot = std::move(snapshot), memory_budget](Build& task_build)
+    {
+        shared_ptr<const TrigramIndex> index = build(task_snapshot, memory_budget, &task_build.cancelled);
+        task_build.finish([&]() { task_build.result = std::move(index); });
+    });
+    return pending;
+}
+
+bool TrigramIndex::findCandidateBlocks(const string_view needle, vector<uint32_t>& blocks) const
+{
+    blocks.clear();
+    if (needle.size() < 3)
+        return false;
+
+    // only trigrams starting within the overlap are sure to be indexed in the match's own block
+    const size_t trigram_count = min(needle.size() - 2, block_overlap);
+    vector<size_t> buckets;
+    for (size_t i = 0; i < trigram_count; ++i)
+        buckets.push_back(getBucket(needle.data() + i));
+    sort(buckets.begin(), buckets.end());
+    buckets.erase(unique(buckets.begin(), buckets.end()), buckets.end());
+    auto getSize = [this](size_t bucket) { return bucket_offsets[bucket + 1] - bucket_offsets[bucket]; };
+    // intersecting from the rarest up keeps the working list as short as it can be
+    sort(buckets.begin(), buckets.end(), [&](size_t a, size_t b) { return getSize(a) < getSize(b); });
+
+    blocks.assign(postings.begin() + bucket_offsets[buckets[0]], postings.begin() + bucket_offsets[buckets[0] + 1]);
+    for (size_t i = 1; i < buckets.size() && !blocks.empty(); ++i)
+    {
+        const auto list_begin = postings.begin() + bucket_offsets[buckets[i]];
+        const auto list_end = postings.begin() + bucket_offsets[buckets[i] + 1];
+        auto position = list_begin;
+        size_t kept = 0;
+        for (const uint32_t block : blocks)
+        {
+            position = lower_bound(position, list_end, block);
+            if (position == list_end)
+                break;
+            if (*position == block)
+                blocks[kept++] = block;
+        }
+        blocks.resize(kept);
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "background_job.h"
+
+// which blocks of a buffer contain each trigram, so a literal search only has to look at the
+// blocks containing every trigram of the needle. trigrams are hashed into a fixed number of
+// buckets, which keeps the table small at the cost of the odd block that turns out not to match.
+// each block also indexes the first few bytes of the next, so a match starting in a block finds
+// all of its leading trigrams there. the index is immutable and only describes the buffer it was
+// built from, so any edit means building another
+class TrigramIndex
+{
+public:
+    static constexpr size_t block_size = 16 * 1024;
+
+    struct Build : BackgroundJob
+    {
+        std::shared_ptr<const TrigramIndex> result; // stays empty if the budget ran out
+        uint64_t version = 0;
+    };
+
+private:
+    static constexpr int bucket_bits = 16;
+    static constexpr size_t bucket_count = size_t{ 1 } << bucket_bits;
+    static constexpr size_t block_overlap = 64;
+
+    size_t text_size = 0;
+    std::vector<uint32_t> bucket_offsets; // where each bucket's blocks start in postings
+    std::vector<uint32_t> postings;       // block numbers, ascending within each bucket
+
+public:
+    // nullptr if the index would need more than memory_budget bytes
+    static std::unique_ptr<TrigramIndex> build(std::string_view buffer, size_t memory_budget, const std::atomic<bool>* cancelled = nullptr);
+    static std::shared_ptr<Build> buildInBackground(ThreadPool& pool, std::string snapshot, uint64_t version, size_t memory_budget);
+
+    size_t getTextSize() const { return text_size; }
+    size_t getMemoryUsage() const { return (bucket_offsets.capacity() + postings.capacity()) * sizeof(uint32_t); }
+
+    // the blocks which could hold the start of a match, in order. false if the needle is too short
+    // to say anything, in which case every block could
+    bool findCandidateBlocks(std::string_view needle, std::vector<uint32_t>& blocks) const;
+
+private:
+    static size_t getBucket(const char* trigram)
+    {
+        const uint32_t key = (static_cast<uint32_t>(static_cast<uint8_t>(trigram[0])) << 16)
+            | (static_cast<uint32_t>(static_cast<uint8_t>(trigram[1])) << 8)
+            | static_cast<uint8_t>(trigram[2]);
+        return (key * 0x9E3779B1u) >> (32 - bucket_bits);
+    }
+};